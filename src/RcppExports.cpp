@@ -6,21 +6,22 @@
 using namespace Rcpp;
 
 // cubical_2dim
-Rcpp::NumericMatrix cubical_2dim(const Rcpp::NumericMatrix& image, double threshold, int method);
-RcppExport SEXP _ripserr_cubical_2dim(SEXP imageSEXP, SEXP thresholdSEXP, SEXP methodSEXP) {
+Rcpp::NumericMatrix cubical_2dim(const Rcpp::NumericMatrix& image, double threshold, int method, bool profile);
+RcppExport SEXP _ripserr_cubical_2dim(SEXP imageSEXP, SEXP thresholdSEXP, SEXP methodSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type image(imageSEXP);
     Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
     Rcpp::traits::input_parameter< int >::type method(methodSEXP);
-    rcpp_result_gen = Rcpp::wrap(cubical_2dim(image, threshold, method));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(cubical_2dim(image, threshold, method, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // cubical_3dim
-Rcpp::NumericMatrix cubical_3dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz);
-RcppExport SEXP _ripserr_cubical_3dim(SEXP imageSEXP, SEXP thresholdSEXP, SEXP methodSEXP, SEXP nxSEXP, SEXP nySEXP, SEXP nzSEXP) {
+Rcpp::NumericMatrix cubical_3dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz, bool profile);
+RcppExport SEXP _ripserr_cubical_3dim(SEXP imageSEXP, SEXP thresholdSEXP, SEXP methodSEXP, SEXP nxSEXP, SEXP nySEXP, SEXP nzSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -30,13 +31,14 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< int >::type nx(nxSEXP);
     Rcpp::traits::input_parameter< int >::type ny(nySEXP);
     Rcpp::traits::input_parameter< int >::type nz(nzSEXP);
-    rcpp_result_gen = Rcpp::wrap(cubical_3dim(image, threshold, method, nx, ny, nz));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(cubical_3dim(image, threshold, method, nx, ny, nz, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // cubical_4dim
-Rcpp::NumericMatrix cubical_4dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz, int nt);
-RcppExport SEXP _ripserr_cubical_4dim(SEXP imageSEXP, SEXP thresholdSEXP, SEXP methodSEXP, SEXP nxSEXP, SEXP nySEXP, SEXP nzSEXP, SEXP ntSEXP) {
+Rcpp::NumericMatrix cubical_4dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz, int nt, bool profile);
+RcppExport SEXP _ripserr_cubical_4dim(SEXP imageSEXP, SEXP thresholdSEXP, SEXP methodSEXP, SEXP nxSEXP, SEXP nySEXP, SEXP nzSEXP, SEXP ntSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -47,46 +49,181 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< int >::type ny(nySEXP);
     Rcpp::traits::input_parameter< int >::type nz(nzSEXP);
     Rcpp::traits::input_parameter< int >::type nt(ntSEXP);
-    rcpp_result_gen = Rcpp::wrap(cubical_4dim(image, threshold, method, nx, ny, nz, nt));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(cubical_4dim(image, threshold, method, nx, ny, nz, nt, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // ripser_cpp_dist
-NumericVector ripser_cpp_dist(const NumericVector& dist_r, int dim, float thresh, int p);
-RcppExport SEXP _ripserr_ripser_cpp_dist(SEXP dist_rSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP) {
+List ripser_cpp_dist(const NumericVector& dist_r, int dim, float thresh, const std::vector<int>& p, int precision, int num_threads, bool collapse, double epsilon, bool profile);
+RcppExport SEXP _ripserr_ripser_cpp_dist(SEXP dist_rSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP precisionSEXP, SEXP num_threadsSEXP, SEXP collapseSEXP, SEXP epsilonSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const NumericVector& >::type dist_r(dist_rSEXP);
     Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
     Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
-    Rcpp::traits::input_parameter< int >::type p(pSEXP);
-    rcpp_result_gen = Rcpp::wrap(ripser_cpp_dist(dist_r, dim, thresh, p));
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse(collapseSEXP);
+    Rcpp::traits::input_parameter< double >::type epsilon(epsilonSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_dist(dist_r, dim, thresh, p, precision, num_threads, collapse, epsilon, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // ripser_cpp
-NumericVector ripser_cpp(const NumericMatrix& input_points, int dim, float thresh, int p, int format);
-RcppExport SEXP _ripserr_ripser_cpp(SEXP input_pointsSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP formatSEXP) {
+List ripser_cpp(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p, int format, int num_threads, int precision, bool collapse, double epsilon, int metric, bool profile);
+RcppExport SEXP _ripserr_ripser_cpp(SEXP input_pointsSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP formatSEXP, SEXP num_threadsSEXP, SEXP precisionSEXP, SEXP collapseSEXP, SEXP epsilonSEXP, SEXP metricSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const NumericMatrix& >::type input_points(input_pointsSEXP);
     Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
     Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
-    Rcpp::traits::input_parameter< int >::type p(pSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
     Rcpp::traits::input_parameter< int >::type format(formatSEXP);
-    rcpp_result_gen = Rcpp::wrap(ripser_cpp(input_points, dim, thresh, p, format));
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse(collapseSEXP);
+    Rcpp::traits::input_parameter< double >::type epsilon(epsilonSEXP);
+    Rcpp::traits::input_parameter< int >::type metric(metricSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp(input_points, dim, thresh, p, format, num_threads, precision, collapse, epsilon, metric, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// ripser_cpp_witness
+List ripser_cpp_witness(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p, int num_threads, int precision, int num_landmarks, int nu, bool collapse, int metric, bool profile);
+RcppExport SEXP _ripserr_ripser_cpp_witness(SEXP input_pointsSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP num_threadsSEXP, SEXP precisionSEXP, SEXP num_landmarksSEXP, SEXP nuSEXP, SEXP collapseSEXP, SEXP metricSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const NumericMatrix& >::type input_points(input_pointsSEXP);
+    Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
+    Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< int >::type num_landmarks(num_landmarksSEXP);
+    Rcpp::traits::input_parameter< int >::type nu(nuSEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse(collapseSEXP);
+    Rcpp::traits::input_parameter< int >::type metric(metricSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_witness(input_points, dim, thresh, p, num_threads, precision, num_landmarks, nu, collapse, metric, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// ripser_cpp_batch
+List ripser_cpp_batch(const List& datasets, int dim, float thresh, const std::vector<int>& p, int precision, int num_threads, bool collapse, double epsilon);
+RcppExport SEXP _ripserr_ripser_cpp_batch(SEXP datasetsSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP precisionSEXP, SEXP num_threadsSEXP, SEXP collapseSEXP, SEXP epsilonSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const List& >::type datasets(datasetsSEXP);
+    Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
+    Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse(collapseSEXP);
+    Rcpp::traits::input_parameter< double >::type epsilon(epsilonSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_batch(datasets, dim, thresh, p, precision, num_threads, collapse, epsilon));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// ripser_cpp_delay
+List ripser_cpp_delay(const NumericVector& series, int data_dim, int dim_lag, int sample_lag, int dim, float thresh, const std::vector<int>& p, int num_threads, int precision, bool collapse, double epsilon, bool profile);
+RcppExport SEXP _ripserr_ripser_cpp_delay(SEXP seriesSEXP, SEXP data_dimSEXP, SEXP dim_lagSEXP, SEXP sample_lagSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP num_threadsSEXP, SEXP precisionSEXP, SEXP collapseSEXP, SEXP epsilonSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const NumericVector& >::type series(seriesSEXP);
+    Rcpp::traits::input_parameter< int >::type data_dim(data_dimSEXP);
+    Rcpp::traits::input_parameter< int >::type dim_lag(dim_lagSEXP);
+    Rcpp::traits::input_parameter< int >::type sample_lag(sample_lagSEXP);
+    Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
+    Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse(collapseSEXP);
+    Rcpp::traits::input_parameter< double >::type epsilon(epsilonSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_delay(series, data_dim, dim_lag, sample_lag, dim, thresh, p, num_threads, precision, collapse, epsilon, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ripser_cpp_estimate
+List ripser_cpp_estimate(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p, int num_threads, int precision, int metric, int num_landmarks);
+RcppExport SEXP _ripserr_ripser_cpp_estimate(SEXP input_pointsSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP num_threadsSEXP, SEXP precisionSEXP, SEXP metricSEXP, SEXP num_landmarksSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const NumericMatrix& >::type input_points(input_pointsSEXP);
+    Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
+    Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    Rcpp::traits::input_parameter< int >::type metric(metricSEXP);
+    Rcpp::traits::input_parameter< int >::type num_landmarks(num_landmarksSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_estimate(input_points, dim, thresh, p, num_threads, precision, metric, num_landmarks));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ripser_cpp_dist_estimate
+List ripser_cpp_dist_estimate(const NumericVector& dist_r, int dim, float thresh, const std::vector<int>& p, int num_threads, int precision);
+RcppExport SEXP _ripserr_ripser_cpp_dist_estimate(SEXP dist_rSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP num_threadsSEXP, SEXP precisionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const NumericVector& >::type dist_r(dist_rSEXP);
+    Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
+    Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_dist_estimate(dist_r, dim, thresh, p, num_threads, precision));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ripser_cpp_delay_estimate
+List ripser_cpp_delay_estimate(const NumericVector& series, int data_dim, int dim_lag, int sample_lag, int dim, float thresh, const std::vector<int>& p, int num_threads, int precision);
+RcppExport SEXP _ripserr_ripser_cpp_delay_estimate(SEXP seriesSEXP, SEXP data_dimSEXP, SEXP dim_lagSEXP, SEXP sample_lagSEXP, SEXP dimSEXP, SEXP threshSEXP, SEXP pSEXP, SEXP num_threadsSEXP, SEXP precisionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const NumericVector& >::type series(seriesSEXP);
+    Rcpp::traits::input_parameter< int >::type data_dim(data_dimSEXP);
+    Rcpp::traits::input_parameter< int >::type dim_lag(dim_lagSEXP);
+    Rcpp::traits::input_parameter< int >::type sample_lag(sample_lagSEXP);
+    Rcpp::traits::input_parameter< int >::type dim(dimSEXP);
+    Rcpp::traits::input_parameter< float >::type thresh(threshSEXP);
+    Rcpp::traits::input_parameter< const std::vector<int>& >::type p(pSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type precision(precisionSEXP);
+    rcpp_result_gen = Rcpp::wrap(ripser_cpp_delay_estimate(series, data_dim, dim_lag, sample_lag, dim, thresh, p, num_threads, precision));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_ripserr_cubical_2dim", (DL_FUNC) &_ripserr_cubical_2dim, 3},
-    {"_ripserr_cubical_3dim", (DL_FUNC) &_ripserr_cubical_3dim, 6},
-    {"_ripserr_cubical_4dim", (DL_FUNC) &_ripserr_cubical_4dim, 7},
-    {"_ripserr_ripser_cpp_dist", (DL_FUNC) &_ripserr_ripser_cpp_dist, 4},
-    {"_ripserr_ripser_cpp", (DL_FUNC) &_ripserr_ripser_cpp, 5},
+    {"_ripserr_cubical_2dim", (DL_FUNC) &_ripserr_cubical_2dim, 4},
+    {"_ripserr_cubical_3dim", (DL_FUNC) &_ripserr_cubical_3dim, 7},
+    {"_ripserr_cubical_4dim", (DL_FUNC) &_ripserr_cubical_4dim, 8},
+    {"_ripserr_ripser_cpp_dist", (DL_FUNC) &_ripserr_ripser_cpp_dist, 9},
+    {"_ripserr_ripser_cpp", (DL_FUNC) &_ripserr_ripser_cpp, 11},
+    {"_ripserr_ripser_cpp_witness", (DL_FUNC) &_ripserr_ripser_cpp_witness, 11},
+    {"_ripserr_ripser_cpp_batch", (DL_FUNC) &_ripserr_ripser_cpp_batch, 8},
+    {"_ripserr_ripser_cpp_delay", (DL_FUNC) &_ripserr_ripser_cpp_delay, 12},
+    {"_ripserr_ripser_cpp_estimate", (DL_FUNC) &_ripserr_ripser_cpp_estimate, 8},
+    {"_ripserr_ripser_cpp_dist_estimate", (DL_FUNC) &_ripserr_ripser_cpp_dist_estimate, 6},
+    {"_ripserr_ripser_cpp_delay_estimate", (DL_FUNC) &_ripserr_ripser_cpp_delay_estimate, 9},
     {NULL, NULL, 0}
 };
 
@@ -36,6 +36,10 @@
 #include <cassert>
 #include <cstdint>
 #include <Rcpp.h>
+#include <memory>
+
+#include "phase_profile.h"
+#include "pivot_column_index.h"
 
 using namespace std;
 
@@ -481,19 +485,39 @@ public:
 
     wp->push_back(WritePairs2(-1, min_birth, dcg->threshold));
     sort(ctr->columns_to_reduce.begin(), ctr->columns_to_reduce.end(), BirthdayIndex2Comparator());
+
+    // union-find keeps an int and two doubles for every slot
+    phase_profile::hold(double(ctr_moi) * (sizeof(int) + 2 * sizeof(double)) +
+                        double(dim1_simplex_list.capacity() + ctr->columns_to_reduce.capacity()) *
+                          sizeof(BirthdayIndex2));
   }
 };
 
-/*****compute_pairs*****/
-template <class Key, class T> class hash_map2 : public unordered_map<Key, T> {};
+/*****pivot_column_index*****/
+// cells of the padded grid for PivotColumnIndex; an index packs x into 11 bits, y into the next 10 and the type above
+struct CellSlots2
+{
+  int ax, ay;
 
+  size_t size() const { return size_t(2) * (ax + 2) * (ay + 2); }
+
+  int operator()(int index) const
+  {
+    int cx = index & 0x07ff,
+        cy = (index >> 11) & 0x03ff,
+        cm = (index >> 21) & 0xff;
+    return (cm * (ay + 2) + cy) * (ax + 2) + cx;
+  }
+};
+
+/*****compute_pairs*****/
 class ComputePairs2
 {
   //member vars
 public:
   DenseCubicalGrids2* dcg;
   ColumnsToReduce2* ctr;
-  hash_map2<int, int> pivot_column_index;
+  PivotColumnIndex<CellSlots2> pivot_column_index;
   int ax, ay;
   int dim;
   vector<WritePairs2> *wp;
@@ -510,6 +534,7 @@ public:
 
     ax = _dcg -> ax;
     ay = _dcg -> ay;
+    pivot_column_index = PivotColumnIndex<CellSlots2>(CellSlots2{ax, ay});
   }
 
   // member methods
@@ -520,9 +545,8 @@ public:
     SimplexCoboundaryEnumerator2 cofaces;
     unordered_map<int, priority_queue<BirthdayIndex2, vector<BirthdayIndex2>, BirthdayIndex2Comparator>> recorded_wc;
 
-    pivot_column_index = hash_map2<int, int>();
     auto ctl_size = ctr->columns_to_reduce.size();
-    pivot_column_index.reserve(ctl_size);
+    pivot_column_index.reset(ctl_size);
     recorded_wc.reserve(ctl_size);
 
     for (int i = 0; i < ctl_size; ++i)
@@ -551,7 +575,7 @@ public:
           coface_entries.push_back(coface);
           if (might_be_apparent_pair && (simplex.getBirthday() == coface.getBirthday())) // if bt is the same, go thru
           {
-            if (pivot_column_index.find(coface.getIndex()) == pivot_column_index.end()) // if coface is not in pivot list
+            if (pivot_column_index.find(coface.getIndex()) == -1) // if coface is not in pivot list
             {
               pivot.copyBirthdayIndex(coface);// I have a new pivot
               goto_found_persistence_pair = true;// goto (B)
@@ -587,10 +611,10 @@ public:
 
           if (pivot.getIndex() != -1) //When I have a pivot, ...
           {
-            auto pair = pivot_column_index.find(pivot.getIndex());
-            if (pair != pivot_column_index.end()) // if the pivot already exists, go on the loop
+            int pivot_column = pivot_column_index.find(pivot.getIndex());
+            if (pivot_column != -1) // if the pivot already exists, go on the loop
             {
-              j = pair->second;
+              j = pivot_column;
               continue;
             }
             else // if the pivot is new,
@@ -600,7 +624,7 @@ public:
               // I output PP as Writepairs
               double death = pivot.getBirthday();
               outputPP(dim, birth, death);
-              pivot_column_index.insert(make_pair(pivot.getIndex(), i));
+              pivot_column_index.insert(pivot.getIndex(), i);
               break;
             }
           }
@@ -614,12 +638,21 @@ public:
         {
           double death = pivot.getBirthday();
           outputPP(dim, birth, death);
-          pivot_column_index.insert(make_pair(pivot.getIndex(), i));
+          pivot_column_index.insert(pivot.getIndex(), i);
           break;
         }
 
       } while (true);
     }
+
+    // the recorded working coboundaries are most of the memory of a dimension
+    if (phase_profile::active() != nullptr)
+    {
+      double bytes = double(ctr->columns_to_reduce.capacity() + coface_entries.capacity()) * sizeof(BirthdayIndex2) +
+        pivot_column_index.bytes() + double(recorded_wc.bucket_count()) * sizeof(void*);
+      for (auto& wc : recorded_wc) bytes += double(wc.second.size()) * sizeof(BirthdayIndex2);
+      phase_profile::hold(bytes);
+    }
   }
 
   void outputPP(int _dim, double _birth, double _death)
@@ -688,7 +721,7 @@ public:
           for (int m = 0; m < typenum; ++m)
           {
             double index = x | (y << 11) | (m << 21);
-            if (pivot_column_index.find(index) == pivot_column_index.end())
+            if (pivot_column_index.find(index) == -1)
             {
               double birthday = dcg -> getBirthday(index, 1);
               if (birthday != dcg -> threshold)
@@ -704,28 +737,62 @@ public:
   }
 };
 
+// reduces dimensions first to last, assembling the columns of each next one, each as a phase of the profile (if any)
+static void compute_pairs_profiled(ComputePairs2* cp, ColumnsToReduce2* ctr, int first, int last)
+{
+  for (int dim = first; dim <= last; ++dim)
+  {
+    {
+      profile_phase phase("compute_pairs", dim);
+      cp->compute_pairs_main();
+    }
+    if (dim < last)
+    {
+      profile_phase phase("assemble", dim + 1);
+      cp->assemble_columns_to_reduce();
+      phase.hold(double(ctr->columns_to_reduce.capacity()) * sizeof(BirthdayIndex2));
+    }
+  }
+}
+
 // method = 0 --> link find algo (default)
 // method = 1 --> compute pairs algo
+// profile = attach the wall time and bytes of each phase as attribute profile (see phase_profile)
 // [[Rcpp::export]]
-Rcpp::NumericMatrix cubical_2dim(const Rcpp::NumericMatrix& image, double threshold, int method)
+Rcpp::NumericMatrix cubical_2dim(const Rcpp::NumericMatrix& image, double threshold, int method, bool profile)
 {
   bool print = false;
 
   vector<WritePairs2> writepairs; // dim birth death
   writepairs.clear();
 
-  DenseCubicalGrids2* dcg = new DenseCubicalGrids2(image, threshold);
-  ColumnsToReduce2* ctr = new ColumnsToReduce2(dcg);
+  unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  DenseCubicalGrids2* dcg;
+  ColumnsToReduce2* ctr;
+  {
+    profile_phase phase("grid");
+    dcg = new DenseCubicalGrids2(image, threshold);
+    phase.hold(sizeof(DenseCubicalGrids2));
+  }
+  {
+    profile_phase phase("columns", 0);
+    ctr = new ColumnsToReduce2(dcg);
+    phase.hold(double(ctr->columns_to_reduce.capacity()) * sizeof(BirthdayIndex2));
+  }
 
   switch(method)
   {
     case 0:
     {
-      JointPairs2* jp = new JointPairs2(dcg, ctr, writepairs, print);
-      jp->joint_pairs_main(); // dim0
+      JointPairs2* jp;
+      {
+        profile_phase phase("joint_pairs", 0);
+        jp = new JointPairs2(dcg, ctr, writepairs, print);
+        jp->joint_pairs_main(); // dim0
+      }
 
       ComputePairs2* cp = new ComputePairs2(dcg, ctr, writepairs, print);
-      cp->compute_pairs_main(); // dim1
+      compute_pairs_profiled(cp, ctr, 1, 1); // dim1
       
       // free pointers
       delete jp;
@@ -737,10 +804,7 @@ Rcpp::NumericMatrix cubical_2dim(const Rcpp::NumericMatrix& image, double thresh
     case 1:
     {
       ComputePairs2* cp = new ComputePairs2(dcg, ctr, writepairs, print);
-      cp->compute_pairs_main(); // dim0
-      cp->assemble_columns_to_reduce();
-
-      cp->compute_pairs_main(); // dim1
+      compute_pairs_profiled(cp, ctr, 0, 1); // dim0, dim1
       
       // free pointers
       delete cp;
@@ -760,5 +824,6 @@ Rcpp::NumericMatrix cubical_2dim(const Rcpp::NumericMatrix& image, double thresh
     ans(i, 1) = writepairs[i].getBirth();
     ans(i, 2) = writepairs[i].getDeath();
   }
+  if (phases) ans.attr("profile") = phases->to_data_frame();
   return ans;
 }
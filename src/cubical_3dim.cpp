@@ -36,6 +36,10 @@
 #include <unordered_map>
 #include <queue>
 #include <Rcpp.h>
+#include <memory>
+
+#include "phase_profile.h"
+#include "pivot_column_index.h"
 
 using namespace std;
 
@@ -762,18 +766,39 @@ public:
     
     wp -> push_back(WritePairs3(-1, min_birth, dcg -> threshold));
     sort(ctr -> columns_to_reduce.begin(), ctr -> columns_to_reduce.end(), BirthdayIndex3Comparator());
+
+    // union-find keeps an int and two doubles for every slot
+    phase_profile::hold(double(ctr_moi) * (sizeof(int) + 2 * sizeof(double)) +
+                        double(dim1_simplex_list.capacity() + ctr -> columns_to_reduce.capacity()) *
+                          sizeof(BirthdayIndex3));
   }
 };
 
-/*****compute_pairs*****/
-template <class Key, class T> class hash_map : public std::unordered_map<Key, T> {};
+/*****pivot_column_index*****/
+// cells of the padded grid for PivotColumnIndex; an index packs x, y and z into 9 bits each and the type above them
+struct CellSlots3
+{
+  int ax, ay, az;
+
+  size_t size() const { return size_t(3) * (ax + 2) * (ay + 2) * (az + 2); }
+
+  int operator()(int index) const
+  {
+    int cx = index & 0x01ff,
+        cy = (index >> 9) & 0x01ff,
+        cz = (index >> 18) & 0x01ff,
+        cm = (index >> 27) & 0xff;
+    return ((cm * (az + 2) + cz) * (ay + 2) + cy) * (ax + 2) + cx;
+  }
+};
 
+/*****compute_pairs*****/
 class ComputePairs3
 {
 public:
   DenseCubicalGrids3* dcg;
   ColumnsToReduce3* ctr;
-  hash_map<int, int> pivot_column_index;
+  PivotColumnIndex<CellSlots3> pivot_column_index;
   int ax, ay, az;
   int dim;
   vector<WritePairs3> *wp;
@@ -788,17 +813,17 @@ public:
     ax = _dcg -> ax;
     ay = _dcg -> ay;
     az = _dcg -> az;
+    pivot_column_index = PivotColumnIndex<CellSlots3>(CellSlots3{ax, ay, az});
   }
   
   void compute_pairs_main()
   {
-    pivot_column_index = hash_map<int, int>();
     vector<BirthdayIndex3> coface_entries;
     auto ctl_size = ctr -> columns_to_reduce.size();
+    pivot_column_index.reset(ctl_size);
     SimplexCoboundaryEnumerator3 cofaces;
     unordered_map<int, priority_queue<BirthdayIndex3, vector<BirthdayIndex3>, BirthdayIndex3Comparator>> recorded_wc;
     
-    pivot_column_index.reserve(ctl_size);
     recorded_wc.reserve(ctl_size);
     
     for(int i = 0; i < ctl_size; ++i) {
@@ -825,7 +850,7 @@ public:
           BirthdayIndex3 coface = cofaces.getNextCoface();
           coface_entries.push_back(coface);
           if (might_be_apparent_pair && (simplex.getBirthday() == coface.getBirthday())) { // If bt is the same, go thru
-            if (pivot_column_index.find(coface.getIndex()) == pivot_column_index.end()) { // If coface is not in pivot list
+            if (pivot_column_index.find(coface.getIndex()) == -1) { // If coface is not in pivot list
               pivot.copyBirthdayIndex3(coface); // I have a new pivot
               goto_found_persistence_pair = true; // goto (B)
             } else { // If pivot list contains this coface,
@@ -852,9 +877,9 @@ public:
           pivot = get_pivot(working_coboundary); // getting a pivot from wc
           
           if (pivot.getIndex() != -1) { // When I have a pivot, ...
-            auto pair = pivot_column_index.find(pivot.getIndex());
-            if (pair != pivot_column_index.end()) {	// If the pivot already exists, go on the loop 
-              j = pair -> second;
+            int pivot_column = pivot_column_index.find(pivot.getIndex());
+            if (pivot_column != -1) {	// If the pivot already exists, go on the loop 
+              j = pivot_column;
               continue;
             } else { // If the pivot is new, 
               // I record this wc into recorded_wc, and 
@@ -862,7 +887,7 @@ public:
               // I output PP as WritePairs
               double death = pivot.getBirthday();
               outputPP(dim, birth, death);
-              pivot_column_index.insert(make_pair(pivot.getIndex(), i));
+              pivot_column_index.insert(pivot.getIndex(), i);
               break;
             }
           } else { // If wc is empty, I output a PP as [birth,) 
@@ -872,12 +897,21 @@ public:
         } else { // (B) I have a new pivot and output PP as Writepairs 
           double death = pivot.getBirthday();
           outputPP(dim, birth, death);
-          pivot_column_index.insert(make_pair(pivot.getIndex(), i));
+          pivot_column_index.insert(pivot.getIndex(), i);
           break;
         }			
         
       } while (true);
     }
+
+    // the recorded working coboundaries are most of the memory of a dimension
+    if (phase_profile::active() != nullptr)
+    {
+      double bytes = double(ctr -> columns_to_reduce.capacity() + coface_entries.capacity()) * sizeof(BirthdayIndex3) +
+        pivot_column_index.bytes() + double(recorded_wc.bucket_count()) * sizeof(void*);
+      for (auto& wc : recorded_wc) bytes += double(wc.second.size()) * sizeof(BirthdayIndex3);
+      phase_profile::hold(bytes);
+    }
   }
   
   void outputPP(int _dim, double _birth, double _death)
@@ -939,7 +973,7 @@ public:
             for (int m = 0; m < 3; ++m) // the number of type
             {
               double index = x | (y << 9) | (z << 18) | (m << 27);
-              if (pivot_column_index.find(index) == pivot_column_index.end())
+              if (pivot_column_index.find(index) == -1)
               {
                 double birthday = dcg -> getBirthday(index, 1);
                 if (birthday != dcg -> threshold)
@@ -956,7 +990,7 @@ public:
             for (int m = 0; m < 3; ++m) // the number of type
             {
               double index = x | (y << 9) | (z << 18) | (m << 27);
-              if (pivot_column_index.find(index) == pivot_column_index.end())
+              if (pivot_column_index.find(index) == -1)
               {
                 double birthday = dcg -> getBirthday(index, 2);
                 if (birthday != dcg -> threshold)
@@ -968,29 +1002,61 @@ public:
   }
 };
 
+// reduces dimensions first to last, assembling the columns of each next one, each as a phase of the profile (if any)
+static void compute_pairs_profiled(ComputePairs3* cp, ColumnsToReduce3* ctr, int first, int last)
+{
+  for (int dim = first; dim <= last; ++dim)
+  {
+    {
+      profile_phase phase("compute_pairs", dim);
+      cp -> compute_pairs_main();
+    }
+    if (dim < last)
+    {
+      profile_phase phase("assemble", dim + 1);
+      cp -> assemble_columns_to_reduce();
+      phase.hold(double(ctr -> columns_to_reduce.capacity()) * sizeof(BirthdayIndex3));
+    }
+  }
+}
+
 // method == 0 --> LINKFIND
 // method == 1 --> COMPUTEPAIRS
+// profile = attach the wall time and bytes of each phase as attribute profile (see phase_profile)
 // [[Rcpp::export]]
-Rcpp::NumericMatrix cubical_3dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz)
+Rcpp::NumericMatrix cubical_3dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz,
+                                 bool profile)
 {
   vector<WritePairs3> writepairs; // dim birth death
   writepairs.clear();
   
-  DenseCubicalGrids3* dcg = new DenseCubicalGrids3(image, threshold, nx, ny, nz);
-  ColumnsToReduce3* ctr = new ColumnsToReduce3(dcg);
+  unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  DenseCubicalGrids3* dcg;
+  ColumnsToReduce3* ctr;
+  {
+    profile_phase phase("grid");
+    dcg = new DenseCubicalGrids3(image, threshold, nx, ny, nz);
+    phase.hold(sizeof(DenseCubicalGrids3));
+  }
+  {
+    profile_phase phase("columns", 0);
+    ctr = new ColumnsToReduce3(dcg);
+    phase.hold(double(ctr -> columns_to_reduce.capacity()) * sizeof(BirthdayIndex3));
+  }
   
   switch (method)
   {
     case 0:
     {
-      JointPairs3* jp = new JointPairs3(dcg, ctr, writepairs);
-      jp -> joint_pairs_main(); // dim0
+      JointPairs3* jp;
+      {
+        profile_phase phase("joint_pairs", 0);
+        jp = new JointPairs3(dcg, ctr, writepairs);
+        jp -> joint_pairs_main(); // dim0
+      }
       
       ComputePairs3* cp = new ComputePairs3(dcg, ctr, writepairs);
-      cp -> compute_pairs_main(); // dim1
-      cp -> assemble_columns_to_reduce();
-      
-      cp -> compute_pairs_main(); // dim2
+      compute_pairs_profiled(cp, ctr, 1, 2); // dim1, dim2
       
       // free pointers
       delete jp;
@@ -1002,13 +1068,7 @@ Rcpp::NumericMatrix cubical_3dim(Rcpp::NumericVector& image, double threshold, i
     case 1:
     {
       ComputePairs3* cp = new ComputePairs3(dcg, ctr, writepairs);
-      cp -> compute_pairs_main(); // dim0
-      cp -> assemble_columns_to_reduce();
-      
-      cp -> compute_pairs_main(); // dim1
-      cp -> assemble_columns_to_reduce();
-      
-      cp -> compute_pairs_main(); // dim2
+      compute_pairs_profiled(cp, ctr, 0, 2); // dim0, dim1, dim2
       
       // free pointers
       delete cp;
@@ -1028,6 +1088,7 @@ Rcpp::NumericMatrix cubical_3dim(Rcpp::NumericVector& image, double threshold, i
     ans(i, 1) = writepairs[i].getBirth();
     ans(i, 2) = writepairs[i].getDeath();
   }
+  if (phases) ans.attr("profile") = phases->to_data_frame();
   
   return ans;
 }
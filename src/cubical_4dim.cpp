@@ -36,6 +36,10 @@
 #include <unordered_map>
 #include <queue>
 #include <Rcpp.h>
+#include <memory>
+
+#include "phase_profile.h"
+#include "pivot_column_index.h"
 
 using namespace std;
 
@@ -1002,18 +1006,41 @@ public:
     
     wp -> push_back(WritePairs4(-1, min_birth, dcg->threshold));
     sort(ctr -> columns_to_reduce.begin(), ctr -> columns_to_reduce.end(), BirthdayIndex4Comparator());
+
+    // union-find keeps an int and two doubles for every slot
+    phase_profile::hold(double(ctr_moi) * (sizeof(int) + 2 * sizeof(double)) +
+                        double(dim1_simplex_list.capacity() + ctr -> columns_to_reduce.capacity()) *
+                          sizeof(BirthdayIndex4));
   }
 };
 
-/*****compute_pairs*****/
-template <class Key, class T> class hash_map4 : public std::unordered_map<Key, T> {};
+/*****pivot_column_index*****/
+// cells of the padded grid for PivotColumnIndex; an index packs x, y, z and w into EXPONENT bits each and the type
+// above them
+struct CellSlots4
+{
+  int ax, ay, az, aw;
+
+  size_t size() const { return size_t(6) * (ax + 2) * (ay + 2) * (az + 2) * (aw + 2); }
 
+  int operator()(int index) const
+  {
+    int cx = index & (MAX_SIZE - 1),
+        cy = (index >> EXPONENT) & (MAX_SIZE - 1),
+        cz = (index >> (2 * EXPONENT)) & (MAX_SIZE - 1),
+        cw = (index >> (3 * EXPONENT)) & (MAX_SIZE - 1),
+        cm = (index >> (4 * EXPONENT)) & 0x0f;
+    return (((cm * (aw + 2) + cw) * (az + 2) + cz) * (ay + 2) + cy) * (ax + 2) + cx;
+  }
+};
+
+/*****compute_pairs*****/
 class ComputePairs4
 {
 public:
   DenseCubicalGrids4* dcg;
   ColumnsToReduce4* ctr;
-  hash_map4<int, int> pivot_column_index;
+  PivotColumnIndex<CellSlots4> pivot_column_index;
   int ax, ay, az, aw;
   int dim;
   vector<WritePairs4> *wp;
@@ -1029,6 +1056,7 @@ public:
     ay = _dcg -> ay;
     az = _dcg -> az;
     aw = _dcg -> aw;
+    pivot_column_index = PivotColumnIndex<CellSlots4>(CellSlots4{ax, ay, az, aw});
   }
   void compute_pairs_main()
   {
@@ -1036,9 +1064,8 @@ public:
     SimplexCoboundaryEnumerator4 cofaces;
     unordered_map<int, priority_queue<BirthdayIndex4, vector<BirthdayIndex4>, BirthdayIndex4Comparator>> recorded_wc;
     
-    pivot_column_index = hash_map4<int, int>();
     auto ctl_size = ctr -> columns_to_reduce.size();
-    pivot_column_index.reserve(ctl_size);
+    pivot_column_index.reset(ctl_size);
     recorded_wc.reserve(ctl_size);
     
     
@@ -1065,7 +1092,7 @@ public:
           BirthdayIndex4 coface = cofaces.getNextCoface();
           coface_entries.push_back(coface);
           if (might_be_apparent_pair && (simplex.getBirthday() == coface.getBirthday())) {
-            if (pivot_column_index.find(coface.getIndex()) == pivot_column_index.end()) {
+            if (pivot_column_index.find(coface.getIndex()) == -1) {
               pivot.copyBirthdayIndex4(coface);
               goto_found_persistence_pair = true;// goto (B)
             } else {
@@ -1091,9 +1118,9 @@ public:
           pivot = get_pivot(working_coboundary);// getting a pivot from wc
           
           if (pivot.getIndex() != -1) {//When I have a pivot, ...
-            auto pair = pivot_column_index.find(pivot.getIndex());
-            if (pair != pivot_column_index.end()) {	// if the pivot already exists, go on the loop 
-              j = pair->second;
+            int pivot_column = pivot_column_index.find(pivot.getIndex());
+            if (pivot_column != -1) {	// if the pivot already exists, go on the loop 
+              j = pivot_column;
               continue;
             } else {// if the pivot is new, 
               // I record this wc into recorded_wc, and 
@@ -1101,7 +1128,7 @@ public:
               // I output PP as WritePairs
               double death = pivot.getBirthday();
               outputPP(dim,birth,death);
-              pivot_column_index.insert(make_pair(pivot.getIndex(), i));
+              pivot_column_index.insert(pivot.getIndex(), i);
               break;
             }
           } else {// if wc is empty, I output a PP as [birth,) 
@@ -1111,12 +1138,21 @@ public:
         } else {// (B) I have a pivot and output PP as WritePairs 
           double death = pivot.getBirthday();
           outputPP(dim,birth,death);
-          pivot_column_index.insert(make_pair(pivot.getIndex(), i));
+          pivot_column_index.insert(pivot.getIndex(), i);
           break;
         }			
         
       } while (true);
     }
+
+    // the recorded working coboundaries are most of the memory of a dimension
+    if (phase_profile::active() != nullptr)
+    {
+      double bytes = double(ctr -> columns_to_reduce.capacity() + coface_entries.capacity()) * sizeof(BirthdayIndex4) +
+        pivot_column_index.bytes() + double(recorded_wc.bucket_count()) * sizeof(void*);
+      for (auto& wc : recorded_wc) bytes += double(wc.second.size()) * sizeof(BirthdayIndex4);
+      phase_profile::hold(bytes);
+    }
   }
   void outputPP(int _dim, double _birth, double _death)
   {
@@ -1168,7 +1204,7 @@ public:
             for (int x = 1; x <= ax; ++x) {
               for (int m = 0; m < 4; ++m) { // the number of type
                 double index = x | (y << EXPONENT) | (z << (2 * EXPONENT)) | (w << (3 * EXPONENT)) | (m << (4 * EXPONENT));
-                if (pivot_column_index.find(index) == pivot_column_index.end()) {
+                if (pivot_column_index.find(index) == -1) {
                   double birthday = dcg -> getBirthday(index, 1);
                   if (birthday != dcg -> threshold) {
                     ctr->columns_to_reduce.push_back(BirthdayIndex4(birthday, index, 1));
@@ -1187,7 +1223,7 @@ public:
             for (int x = 1; x <= ax; ++x) {
               for (int m = 0; m < 6; ++m) { // the number of type
                 double index = x | (y << EXPONENT) | (z << (2 * EXPONENT)) | (w << (3 * EXPONENT)) | (m << (4 * EXPONENT));
-                if (pivot_column_index.find(index) == pivot_column_index.end()) {
+                if (pivot_column_index.find(index) == -1) {
                   double birthday = dcg -> getBirthday(index, 2);
                   if (birthday != dcg -> threshold) {
                     ctr->columns_to_reduce.push_back(BirthdayIndex4(birthday, index, 2));
@@ -1206,7 +1242,7 @@ public:
             for (int x = 1; x <= ax; ++x) {
               for (int m = 0; m < 4; ++m) { // the number of type
                 double index = x | (y << EXPONENT) | (z << (2 * EXPONENT)) | (w << (3 * EXPONENT)) | (m << (4 * EXPONENT));
-                if (pivot_column_index.find(index) == pivot_column_index.end()) {
+                if (pivot_column_index.find(index) == -1) {
                   double birthday = dcg -> getBirthday(index, 3);
                   if (birthday != dcg -> threshold) {
                     ctr -> columns_to_reduce.push_back(BirthdayIndex4(birthday, index, 3));
@@ -1222,31 +1258,60 @@ public:
   }
 };
 
+// reduces dimensions first to last, assembling the columns of each next one, each as a phase of the profile (if any)
+static void compute_pairs_profiled(ComputePairs4* cp, ColumnsToReduce4* ctr, int first, int last)
+{
+  for (int dim = first; dim <= last; ++dim)
+  {
+    {
+      profile_phase phase("compute_pairs", dim);
+      cp -> compute_pairs_main();
+    }
+    if (dim < last)
+    {
+      profile_phase phase("assemble", dim + 1);
+      cp -> assemble_columns_to_reduce();
+      phase.hold(double(ctr -> columns_to_reduce.capacity()) * sizeof(BirthdayIndex4));
+    }
+  }
+}
+
 // method == 0 --> LINKFIND algorithm
 // method == 1 --> COMPUTEPAIRS algorithm
+// profile = attach the wall time and bytes of each phase as attribute profile (see phase_profile)
 // [[Rcpp::export]]
-Rcpp::NumericMatrix cubical_4dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz, int nt)
+Rcpp::NumericMatrix cubical_4dim(Rcpp::NumericVector& image, double threshold, int method, int nx, int ny, int nz, int nt,
+                                 bool profile)
 {
   vector<WritePairs4> writepairs; // dim birth death
   writepairs.clear();
   
-  DenseCubicalGrids4* dcg = new DenseCubicalGrids4(image, threshold, nx, ny, nz, nt);
-  ColumnsToReduce4* ctr = new ColumnsToReduce4(dcg); 
+  unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  DenseCubicalGrids4* dcg;
+  ColumnsToReduce4* ctr;
+  {
+    profile_phase phase("grid");
+    dcg = new DenseCubicalGrids4(image, threshold, nx, ny, nz, nt);
+    phase.hold(sizeof(DenseCubicalGrids4));
+  }
+  {
+    profile_phase phase("columns", 0);
+    ctr = new ColumnsToReduce4(dcg);
+    phase.hold(double(ctr -> columns_to_reduce.capacity()) * sizeof(BirthdayIndex4));
+  }
   
   switch(method){
   case 0:
   {
-    JointPairs4* jp = new JointPairs4(dcg, ctr, writepairs);
-    jp -> joint_pairs_main();
+    JointPairs4* jp;
+    {
+      profile_phase phase("joint_pairs", 0);
+      jp = new JointPairs4(dcg, ctr, writepairs);
+      jp -> joint_pairs_main();
+    }
     
     ComputePairs4* cp = new ComputePairs4(dcg, ctr, writepairs);
-    cp -> compute_pairs_main(); // dim1
-    
-    cp -> assemble_columns_to_reduce();
-    cp -> compute_pairs_main(); // dim2
-    
-    cp -> assemble_columns_to_reduce();
-    cp -> compute_pairs_main(); // dim3
+    compute_pairs_profiled(cp, ctr, 1, 3); // dim1, dim2, dim3
     
     // free pointers
     delete jp;
@@ -1257,16 +1322,7 @@ Rcpp::NumericMatrix cubical_4dim(Rcpp::NumericVector& image, double threshold, i
   case 1:
   {	
     ComputePairs4* cp = new ComputePairs4(dcg, ctr, writepairs);
-    cp -> compute_pairs_main(); // dim0
-    cp -> assemble_columns_to_reduce();
-    
-    cp -> compute_pairs_main(); // dim1
-    cp -> assemble_columns_to_reduce();
-    
-    cp -> compute_pairs_main(); // dim2
-    cp -> assemble_columns_to_reduce();
-    
-    cp -> compute_pairs_main(); // dim3
+    compute_pairs_profiled(cp, ctr, 0, 3); // dim0, dim1, dim2, dim3
     
     // free pointers
     delete cp;
@@ -1286,6 +1342,7 @@ Rcpp::NumericMatrix cubical_4dim(Rcpp::NumericVector& image, double threshold, i
     ans(i, 1) = writepairs[i].getBirth();
     ans(i, 2) = writepairs[i].getDeath();
   }
+  if (phases) ans.attr("profile") = phases->to_data_frame();
   
   return ans;
 }
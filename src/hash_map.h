@@ -0,0 +1,82 @@
+// Open-addressing hash table for pivot indices; shared by the Ripser and Cubical Ripser engines
+
+#ifndef RIPSERR_HASH_MAP_H
+#define RIPSERR_HASH_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Fibonacci hashing spreads consecutive simplex indices over the whole table
+inline size_t hash_index(int64_t key, size_t capacity) {
+  uint64_t h = uint64_t(key) * UINT64_C(0x9E3779B97F4A7C15);
+  return size_t(h ^ (h >> 32)) & (capacity - 1);
+}
+
+// open-addressing hash table with linear probing for non-negative integer keys; a key of -1 marks an empty slot,
+// so a lookup scans a few adjacent slots instead of chasing bucket nodes, and an insert never allocates a node
+template <class Key, class T> class hash_map {
+  public:
+    typedef std::pair<Key, T> value_type;
+    typedef const value_type* const_iterator;
+
+    hash_map() : slots(min_capacity, value_type(-1, T())), num_entries(0) {}
+
+    const_iterator find(Key key) const {
+      for (size_t s = home_slot(key);; s = (s + 1) & (slots.size() - 1)) {
+        if (slots[s].first == key) return &slots[s];
+        if (slots[s].first == -1) return end();
+      }
+    }
+
+    const_iterator end() const { return slots.data() + slots.size(); }
+
+    size_t size() const { return num_entries; }
+
+    double bytes() const { return double(slots.capacity()) * sizeof(value_type); }
+
+    // keeps the value already stored under the key, like std::unordered_map::insert
+    void insert(const value_type& entry) {
+      if (2 * (num_entries + 1) > slots.size()) rehash(2 * slots.size());
+      size_t s = home_slot(entry.first);
+      for (; slots[s].first != -1; s = (s + 1) & (slots.size() - 1))
+        if (slots[s].first == entry.first) return;
+      slots[s] = entry;
+      ++num_entries;
+    }
+
+    void reserve(size_t n) { if (capacity_for(n) > slots.size()) rehash(capacity_for(n)); }
+
+    // empties the table, keeping its slots
+    void clear() {
+      std::fill(slots.begin(), slots.end(), value_type(-1, T()));
+      num_entries = 0;
+    }
+
+    // number of slots a table reserved for n entries has
+    static size_t capacity_for(size_t n) {
+      size_t capacity = min_capacity;
+      while (capacity < 2 * n) capacity *= 2;
+      return capacity;
+    }
+
+  private:
+    static const size_t min_capacity = 16;
+
+    std::vector<value_type> slots;
+    size_t num_entries;
+
+    size_t home_slot(Key key) const { return hash_index(key, slots.size()); }
+
+    void rehash(size_t capacity) {
+      std::vector<value_type> old_slots(capacity, value_type(-1, T()));
+      old_slots.swap(slots);
+      num_entries = 0;
+      for (const value_type& entry : old_slots)
+        if (entry.first != -1) insert(entry);
+    }
+};
+
+#endif
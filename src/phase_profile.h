@@ -0,0 +1,101 @@
+// Per-phase wall time and memory of a persistent homology calculation, for profile = TRUE in vietoris_rips and
+// cubical; shared by the Ripser and Cubical Ripser engines
+
+#ifndef RIPSERR_PHASE_PROFILE_H
+#define RIPSERR_PHASE_PROFILE_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <Rcpp.h>
+
+// the phases of one calculation, one row each in the order they started; the bytes of a phase are those of the
+// vectors and tables the engine holds in it, at their largest (memory held by R or lost to the allocator is not
+// counted); a profile records the phases of the thread that created it for as long as it is in scope, and without
+// one a phase costs a single pointer check
+class phase_profile {
+  public:
+    phase_profile() : previous(active()), open(-1) { active() = this; }
+    ~phase_profile() { active() = previous; }
+
+    phase_profile(const phase_profile&) = delete;
+    phase_profile& operator=(const phase_profile&) = delete;
+
+    // the profile of the calling thread, or nullptr
+    static phase_profile*& active() {
+      static thread_local phase_profile* profile = nullptr;
+      return profile;
+    }
+
+    // reports bytes held by the innermost phase in progress on the calling thread, from code that does not own it
+    static void hold(double num_bytes) {
+      phase_profile* profile = active();
+      if (profile == nullptr || profile->open < 0) return;
+      profile->bytes[profile->open] = std::max(profile->bytes[profile->open], num_bytes);
+    }
+
+    // dimension and p are NA for phases that serve every dimension or every prime
+    Rcpp::DataFrame to_data_frame() const {
+      Rcpp::IntegerVector dimension(dimensions.begin(), dimensions.end()), p(primes.begin(), primes.end());
+      for (size_t k = 0; k < phases.size(); ++k) {
+        if (dimensions[k] < 0) dimension[k] = NA_INTEGER;
+        if (primes[k] < 0) p[k] = NA_INTEGER;
+      }
+      return Rcpp::DataFrame::create(Rcpp::Named("phase") = Rcpp::CharacterVector(phases.begin(), phases.end()),
+                                     Rcpp::Named("dimension") = dimension, Rcpp::Named("p") = p,
+                                     Rcpp::Named("seconds") = Rcpp::NumericVector(seconds.begin(), seconds.end()),
+                                     Rcpp::Named("bytes") = Rcpp::NumericVector(bytes.begin(), bytes.end()),
+                                     Rcpp::Named("stringsAsFactors") = false);
+    }
+
+  private:
+    friend class profile_phase;
+
+    phase_profile* previous;
+    // row of the innermost phase that has not ended yet
+    long open;
+    std::vector<std::string> phases;
+    std::vector<int> dimensions, primes;
+    std::vector<double> seconds, bytes;
+};
+
+// times its own lifetime as a phase of the profile of the calling thread, if it has one; phases may nest, and
+// phase_profile::hold reports to the innermost one
+class profile_phase {
+  public:
+    explicit profile_phase(const char* name, int dim = -1, int p = -1) : profile(phase_profile::active()) {
+      if (profile == nullptr) return;
+      row = profile->phases.size();
+      parent = profile->open;
+      profile->open = row;
+      profile->phases.push_back(name);
+      profile->dimensions.push_back(dim);
+      profile->primes.push_back(p);
+      profile->seconds.push_back(0);
+      profile->bytes.push_back(0);
+      start = std::chrono::steady_clock::now();
+    }
+
+    ~profile_phase() {
+      if (profile == nullptr) return;
+      profile->seconds[row] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      profile->open = parent;
+    }
+
+    profile_phase(const profile_phase&) = delete;
+    profile_phase& operator=(const profile_phase&) = delete;
+
+    // the phase holds this many bytes at some point; it keeps the largest amount reported
+    void hold(double num_bytes) {
+      if (profile != nullptr) profile->bytes[row] = std::max(profile->bytes[row], num_bytes);
+    }
+
+  private:
+    phase_profile* profile;
+    long row, parent;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,70 @@
+// Pivot index of the Cubical Ripser engines; shared by the 2, 3 and 4 dimensional ones
+
+#ifndef RIPSERR_PIVOT_COLUMN_INDEX_H
+#define RIPSERR_PIVOT_COLUMN_INDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "hash_map.h"
+
+// maps a cell index to the column whose pivot it is; Cells gives the number of cells of the grid (padding included)
+// and the position of each, with the type of cell as the slowest coordinate so one x-row of a type is contiguous;
+// when the cells take no more memory than a hash_map of the columns of a dimension, the pivots go to a flat array,
+// kept from one dimension to the next, so a lookup is a single load
+template <class Cells> class PivotColumnIndex
+{
+public:
+  PivotColumnIndex() : dense(false) {}
+  explicit PivotColumnIndex(const Cells& _cells) : cells(_cells), dense(false) {}
+
+  // empties the index for a dimension of num_columns columns, each of which takes at most one pivot
+  void reset(size_t num_columns)
+  {
+    typedef hash_map<int, int> pivot_map;
+    dense = cells.size() * sizeof(int) <= pivot_map::capacity_for(num_columns) * sizeof(pivot_map::value_type);
+    if (dense)
+    {
+      if (column.size() == cells.size()) std::fill(column.begin(), column.end(), -1);
+      else column.assign(cells.size(), -1);
+      sparse_column = pivot_map();
+    }
+    else
+    {
+      std::vector<int>().swap(column);
+      sparse_column.clear();
+      sparse_column.reserve(num_columns);
+    }
+  }
+
+  // returns -1 if index is not a pivot
+  int find(int index) const
+  {
+    if (dense) return column[cells(index)];
+    auto pair = sparse_column.find(index);
+    return pair == sparse_column.end() ? -1 : pair->second;
+  }
+
+  // keeps the column already stored for index
+  void insert(int index, int i)
+  {
+    if (!dense)
+    {
+      sparse_column.insert(std::make_pair(index, i));
+      return;
+    }
+    int& entry = column[cells(index)];
+    if (entry == -1) entry = i;
+  }
+
+  double bytes() const { return double(column.capacity()) * sizeof(int) + sparse_column.bytes(); }
+
+private:
+  Cells cells;
+  std::vector<int> column;
+  hash_map<int, int> sparse_column;
+  bool dense;
+};
+
+#endif
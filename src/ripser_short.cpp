@@ -33,19 +33,39 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <queue>
+#include <random>
 #include <sstream>
-#include <unordered_map>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#define USE_FC_LEN_T
 #include <Rcpp.h>
+#include <R_ext/BLAS.h>
+
+#include "hash_map.h"
+#include "phase_profile.h"
+#ifndef FCONE
+#define FCONE
+#endif
 
 using namespace Rcpp;
 
-template <class Key, class T> class hash_map : public std::unordered_map<Key, T> {};
+// R may only be called from the thread that loaded the package, on which R runs
+static const std::thread::id r_thread_id = std::this_thread::get_id();
+inline bool on_r_thread() { return std::this_thread::get_id() == r_thread_id; }
+
+// memory a vector holds, which is what the phases of a profile count
+template <typename T> double vector_bytes(const std::vector<T>& v) { return double(v.capacity()) * sizeof(T); }
 
 typedef double value_t_ripser;
 typedef int64_t index_t_ripser;
@@ -53,23 +73,28 @@ typedef uint8_t coefficient_t_ripser;
 
 static const size_t num_coefficient_bits = 8;
 
+// largest simplex index an entry_t can hold next to its coefficient, the index being a signed bit field
+static const index_t_ripser max_simplex_index =
+  (index_t_ripser(1) << (8 * sizeof(index_t_ripser) - 1 - num_coefficient_bits)) - 1;
+
+// one contiguous row of binomial coefficients per k, so the binary search over n for a fixed k in
+// get_next_vertex stays within a single row; every coefficient is a simplex index (or a bound on one), so
+// the table refuses to hold one above max_index
 class binomial_coeff_table {
-  std::vector<std::vector<index_t_ripser>> B;
+  std::vector<index_t_ripser> B;
   index_t_ripser n_max, k_max;
 
   public:
-    binomial_coeff_table(index_t_ripser n, index_t_ripser k) {
-      n_max = n;
-      k_max = k;
-
-      B.resize(n + 1);
+    binomial_coeff_table(index_t_ripser n, index_t_ripser k, index_t_ripser max_index = max_simplex_index)
+    : B((k + 1) * (n + 1), 0), n_max(n), k_max(k) {
       for (index_t_ripser i = 0; i <= n; i++) {
-        B[i].resize(k + 1);
-        for (index_t_ripser j = 0; j <= std::min(i, k); j++) {
-          if (j == 0 || j == i)
-            B[i][j] = 1;
-          else
-            B[i][j] = B[i - 1][j - 1] + B[i - 1][j];
+        B[i] = 1;
+        for (index_t_ripser j = 1; j <= std::min(i, k); j++) {
+          const index_t_ripser a = B[(j - 1) * (n + 1) + i - 1], b = B[j * (n + 1) + i - 1];
+          // a standard exception, which Rcpp turns into an R error, since the table may be built on a worker thread
+          if (a > max_index - b)
+            throw std::overflow_error("Too many simplices to index; reduce max_dim or the number of points.");
+          B[j * (n + 1) + i] = a + b;
         }
       }
     }
@@ -77,10 +102,18 @@ class binomial_coeff_table {
   index_t_ripser operator()(index_t_ripser n, index_t_ripser k) const {
     assert(n <= n_max);
     assert(k <= k_max);
-    return B[n][k];
+    return B[k * (n_max + 1) + n];
   }
 };
 
+// the largest simplex index a reduction in all of primes can hold; Z/2 entries have no coefficient bits, so their
+// indices may use all of index_t_ripser
+inline index_t_ripser max_simplex_index_for(const std::vector<int>& primes) {
+  return std::all_of(primes.begin(), primes.end(), [](int p) { return p == 2; })
+           ? std::numeric_limits<index_t_ripser>::max()
+           : max_simplex_index;
+}
+
 bool is_prime(const coefficient_t_ripser n) {
   if (!(n & 1) || n < 2) return n == 2;
   for (coefficient_t_ripser p = 3, q = n / p, r = n % p; p <= q; p += 2, q = n / p, r = n % p)
@@ -95,6 +128,24 @@ std::vector<coefficient_t_ripser> multiplicative_inverse_vector(const coefficien
                                                                          return inverse;
 }
 
+// arithmetic in Z/p through lookup tables, so that no coefficient update in the reduction needs a division
+class prime_field {
+  coefficient_t_ripser p;
+  std::vector<coefficient_t_ripser> inverses, products;
+
+  public:
+    explicit prime_field(coefficient_t_ripser _p)
+    : p(_p), inverses(multiplicative_inverse_vector(_p)), products(size_t(_p) * _p) {
+      for (unsigned a = 0; a < p; ++a)
+        for (unsigned b = 0; b < p; ++b) products[a * p + b] = a * b % p;
+    }
+
+  coefficient_t_ripser modulus() const { return p; }
+  coefficient_t_ripser negate(coefficient_t_ripser a) const { return a == 0 ? 0 : p - a; }
+  coefficient_t_ripser multiply(coefficient_t_ripser a, coefficient_t_ripser b) const { return products[a * p + b]; }
+  coefficient_t_ripser inverse(coefficient_t_ripser a) const { return inverses[a]; }
+};
+
 index_t_ripser get_next_vertex(index_t_ripser& v, const index_t_ripser idx, const index_t_ripser k, const binomial_coeff_table& binomial_coeff) {
   if (binomial_coeff(v, k) > idx) {
     index_t_ripser count = v;
@@ -152,37 +203,83 @@ void set_coefficient(entry_t& e, const coefficient_t_ripser c) { e.coefficient =
 
 const entry_t& get_entry(const entry_t& e) { return e; }
 
+// adds the coefficient of b to that of a and returns the sum
+coefficient_t_ripser add_coefficient(entry_t& a, const entry_t& b, coefficient_t_ripser modulus) {
+  unsigned sum = a.coefficient + b.coefficient;
+  a.coefficient = sum >= modulus ? sum - modulus : sum;
+  return a.coefficient;
+}
+
+// over Z/2 every nonzero coefficient is 1, so an entry needs no coefficient bits and keeps the whole
+// index_t_ripser for its index; two entries with the same index always cancel
+#pragma pack(1)
+struct z2_entry_t {
+  index_t_ripser index;
+  z2_entry_t(index_t_ripser _index, coefficient_t_ripser) : index(_index) {}
+  z2_entry_t(index_t_ripser _index) : index(_index) {}
+  z2_entry_t() : index(0) {}
+};
+#pragma pack() // reset
+
+index_t_ripser get_index(const z2_entry_t& e) { return e.index; }
+index_t_ripser get_coefficient(const z2_entry_t&) { return 1; }
+void set_coefficient(z2_entry_t&, const coefficient_t_ripser) {}
+
+const z2_entry_t& get_entry(const z2_entry_t& e) { return e; }
+
+coefficient_t_ripser add_coefficient(z2_entry_t&, const z2_entry_t&, coefficient_t_ripser) { return 0; }
+
 template <typename Entry> struct smaller_index {
   bool operator()(const Entry& a, const Entry& b) { return get_index(a) < get_index(b); }
 };
 
-class diameter_index_t : public std::pair<value_t_ripser, index_t_ripser> {
+// the diameter type follows the value type of the distance matrix, so single precision halves every entry
+template <typename ValueType> class diameter_index_t : public std::pair<ValueType, index_t_ripser> {
   public:
-    diameter_index_t() : std::pair<value_t_ripser, index_t_ripser>() {}
-  diameter_index_t(std::pair<value_t_ripser, index_t_ripser> p) : std::pair<value_t_ripser, index_t_ripser>(p) {}
+    diameter_index_t() : std::pair<ValueType, index_t_ripser>() {}
+  diameter_index_t(std::pair<ValueType, index_t_ripser> p) : std::pair<ValueType, index_t_ripser>(p) {}
 };
-value_t_ripser get_diameter(diameter_index_t i) { return i.first; }
-index_t_ripser get_index(diameter_index_t i) { return i.second; }
+template <typename ValueType> ValueType get_diameter(const diameter_index_t<ValueType>& i) { return i.first; }
+template <typename ValueType> index_t_ripser get_index(const diameter_index_t<ValueType>& i) { return i.second; }
 
-class diameter_entry_t : public std::pair<value_t_ripser, entry_t> {
+// Entry is entry_t, or z2_entry_t when the coefficients are in Z/2
+template <typename ValueType, typename Entry = entry_t> class diameter_entry_t : public std::pair<ValueType, Entry> {
   public:
-    diameter_entry_t(std::pair<value_t_ripser, entry_t> p) : std::pair<value_t_ripser, entry_t>(p) {}
-  diameter_entry_t(entry_t e) : std::pair<value_t_ripser, entry_t>(0, e) {}
-  diameter_entry_t() : diameter_entry_t(0) {}
-  diameter_entry_t(value_t_ripser _diameter, index_t_ripser _index, coefficient_t_ripser _coefficient)
-  : std::pair<value_t_ripser, entry_t>(_diameter, make_entry(_index, _coefficient)) {}
-  diameter_entry_t(diameter_index_t _diameter_index, coefficient_t_ripser _coefficient)
-  : std::pair<value_t_ripser, entry_t>(get_diameter(_diameter_index),
-                                       make_entry(get_index(_diameter_index), _coefficient)) {}
-  diameter_entry_t(diameter_index_t _diameter_index) : diameter_entry_t(_diameter_index, 1) {}
+    diameter_entry_t(std::pair<ValueType, Entry> p) : std::pair<ValueType, Entry>(p) {}
+  diameter_entry_t(Entry e) : std::pair<ValueType, Entry>(0, e) {}
+  diameter_entry_t() : diameter_entry_t(Entry(0)) {}
+  diameter_entry_t(ValueType _diameter, index_t_ripser _index, coefficient_t_ripser _coefficient)
+  : std::pair<ValueType, Entry>(_diameter, Entry(_index, _coefficient)) {}
+  diameter_entry_t(diameter_index_t<ValueType> _diameter_index, coefficient_t_ripser _coefficient)
+  : std::pair<ValueType, Entry>(get_diameter(_diameter_index), Entry(get_index(_diameter_index), _coefficient)) {}
+  diameter_entry_t(diameter_index_t<ValueType> _diameter_index) : diameter_entry_t(_diameter_index, 1) {}
 };
 
-const entry_t& get_entry(const diameter_entry_t& p) { return p.second; }
-entry_t& get_entry(diameter_entry_t& p) { return p.second; }
-const index_t_ripser get_index(const diameter_entry_t& p) { return get_index(get_entry(p)); }
-const coefficient_t_ripser get_coefficient(const diameter_entry_t& p) { return get_coefficient(get_entry(p)); }
-const value_t_ripser& get_diameter(const diameter_entry_t& p) { return p.first; }
-void set_coefficient(diameter_entry_t& p, const coefficient_t_ripser c) { set_coefficient(get_entry(p), c); }
+template <typename ValueType, typename Entry> const Entry& get_entry(const diameter_entry_t<ValueType, Entry>& p) {
+  return p.second;
+}
+template <typename ValueType, typename Entry> Entry& get_entry(diameter_entry_t<ValueType, Entry>& p) {
+  return p.second;
+}
+template <typename ValueType, typename Entry> const index_t_ripser get_index(const diameter_entry_t<ValueType, Entry>& p) {
+  return get_index(get_entry(p));
+}
+template <typename ValueType, typename Entry>
+  const coefficient_t_ripser get_coefficient(const diameter_entry_t<ValueType, Entry>& p) {
+  return get_coefficient(get_entry(p));
+}
+template <typename ValueType, typename Entry> const ValueType& get_diameter(const diameter_entry_t<ValueType, Entry>& p) {
+  return p.first;
+}
+template <typename ValueType, typename Entry>
+  void set_coefficient(diameter_entry_t<ValueType, Entry>& p, const coefficient_t_ripser c) {
+  set_coefficient(get_entry(p), c);
+}
+template <typename ValueType, typename Entry>
+  coefficient_t_ripser add_coefficient(diameter_entry_t<ValueType, Entry>& a, const diameter_entry_t<ValueType, Entry>& b,
+                                       coefficient_t_ripser modulus) {
+  return add_coefficient(get_entry(a), get_entry(b), modulus);
+}
 
 template <typename Entry> struct greater_diameter_or_smaller_index {
   bool operator()(const Entry& a, const Entry& b) {
@@ -192,6 +289,8 @@ template <typename Entry> struct greater_diameter_or_smaller_index {
 };
 
 template <typename DistanceMatrix> class rips_filtration_comparator {
+  typedef typename DistanceMatrix::value_type value_t;
+
   public:
     const DistanceMatrix& dist;
   const index_t_ripser dim;
@@ -205,8 +304,8 @@ template <typename DistanceMatrix> class rips_filtration_comparator {
                                const binomial_coeff_table& _binomial_coeff)
   : dist(_dist), dim(_dim), vertices(_dim + 1), binomial_coeff(_binomial_coeff){};
 
-  value_t_ripser diameter(const index_t_ripser index) const {
-    value_t_ripser diam = 0;
+  value_t diameter(const index_t_ripser index) const {
+    value_t diam = 0;
     get_simplex_vertices(index, dim, dist.size(), binomial_coeff, vertices.begin());
 
     for (index_t_ripser i = 0; i <= dim; ++i)
@@ -218,8 +317,8 @@ template <typename DistanceMatrix> class rips_filtration_comparator {
     assert(a < binomial_coeff(dist.size(), dim + 1));
     assert(b < binomial_coeff(dist.size(), dim + 1));
 
-    return greater_diameter_or_smaller_index<diameter_index_t>()(diameter_index_t(diameter(a), a),
-                                                                 diameter_index_t(diameter(b), b));
+    return greater_diameter_or_smaller_index<diameter_index_t<value_t>>()(
+      diameter_index_t<value_t>(std::make_pair(diameter(a), a)), diameter_index_t<value_t>(std::make_pair(diameter(b), b)));
   }
 
   template <typename Entry> bool operator()(const Entry& a, const Entry& b) const {
@@ -227,9 +326,11 @@ template <typename DistanceMatrix> class rips_filtration_comparator {
   }
 };
 
-template <class DistanceMatrix> class simplex_coboundary_enumerator {
+template <class DistanceMatrix, class Entry = entry_t> class simplex_coboundary_enumerator {
+  typedef typename DistanceMatrix::value_type value_t;
+
   private:
-    const diameter_entry_t simplex;
+    const diameter_entry_t<value_t, Entry> simplex;
   index_t_ripser idx_below, idx_above, v, k;
   const coefficient_t_ripser modulus;
   const binomial_coeff_table& binomial_coeff;
@@ -237,16 +338,22 @@ template <class DistanceMatrix> class simplex_coboundary_enumerator {
   std::vector<index_t_ripser> vertices;
 
   public:
-    simplex_coboundary_enumerator(const diameter_entry_t _simplex, index_t_ripser _dim, index_t_ripser _n,
+    // _vertices, if given, are the vertices of the simplex in decreasing order, which then need no decoding
+    simplex_coboundary_enumerator(const diameter_entry_t<value_t, Entry> _simplex, index_t_ripser _dim, index_t_ripser _n,
                                   const coefficient_t_ripser _modulus, const DistanceMatrix& _dist,
-                                  const binomial_coeff_table& _binomial_coeff)
+                                  const binomial_coeff_table& _binomial_coeff,
+                                  const std::vector<index_t_ripser>* _vertices = nullptr)
   : simplex(_simplex), idx_below(get_index(_simplex)), idx_above(0), v(_n - 1), k(_dim + 1), modulus(_modulus),
   binomial_coeff(_binomial_coeff), dist(_dist), vertices(_dim + 1) {
-    get_simplex_vertices(get_index(_simplex), _dim, _n, binomial_coeff, vertices.begin());
+    if (_vertices)
+      vertices = *_vertices;
+    else
+      get_simplex_vertices(get_index(_simplex), _dim, _n, binomial_coeff, vertices.begin());
   }
 
-  bool has_next() {
+  bool has_next(bool all_cofaces = true) {
     while ((v != -1) && (binomial_coeff(v, k) <= idx_below)) {
+      if (!all_cofaces) return false;
       idx_below -= binomial_coeff(v, k);
       idx_above += binomial_coeff(v, k + 1);
 
@@ -259,86 +366,525 @@ template <class DistanceMatrix> class simplex_coboundary_enumerator {
 
   index_t_ripser next_index() { return idx_above + binomial_coeff(v--, k + 1) + idx_below; }
 
-  diameter_entry_t next() {
-    value_t_ripser coface_diameter = get_diameter(simplex);
+  diameter_entry_t<value_t, Entry> next() {
+    value_t coface_diameter = get_diameter(simplex);
     for (index_t_ripser w : vertices) coface_diameter = std::max(coface_diameter, dist(v, w));
-    coefficient_t_ripser coface_coefficient = (k & 1 ? -1 + modulus : 1) * get_coefficient(simplex) % modulus;
-    return diameter_entry_t(coface_diameter, idx_above + binomial_coeff(v--, k + 1) + idx_below,
+    coefficient_t_ripser coface_coefficient = k & 1 ? modulus - get_coefficient(simplex) : get_coefficient(simplex);
+    return diameter_entry_t<value_t, Entry>(coface_diameter, idx_above + binomial_coeff(v--, k + 1) + idx_below,
                             coface_coefficient);
   }
 };
 
+// enumerates the facets of a simplex in increasing order of their index, i.e. removing its vertices
+// from the largest to the smallest
+template <class DistanceMatrix, class Entry = entry_t> class simplex_boundary_enumerator {
+  typedef typename DistanceMatrix::value_type value_t;
+
+  private:
+    const diameter_entry_t<value_t, Entry> simplex;
+  index_t_ripser idx_below, idx_above, dim, p;
+  const coefficient_t_ripser modulus;
+  const binomial_coeff_table& binomial_coeff;
+  const DistanceMatrix& dist;
+  std::vector<index_t_ripser> vertices;
+
+  public:
+    simplex_boundary_enumerator(const diameter_entry_t<value_t, Entry> _simplex, index_t_ripser _dim, index_t_ripser _n,
+                                const coefficient_t_ripser _modulus, const DistanceMatrix& _dist,
+                                const binomial_coeff_table& _binomial_coeff,
+                                const std::vector<index_t_ripser>* _vertices = nullptr)
+  : simplex(_simplex), idx_below(get_index(_simplex)), idx_above(0), dim(_dim), p(0), modulus(_modulus),
+  binomial_coeff(_binomial_coeff), dist(_dist), vertices(_dim + 1) {
+    if (_vertices)
+      vertices = *_vertices;
+    else
+      get_simplex_vertices(get_index(_simplex), _dim, _n, binomial_coeff, vertices.begin());
+  }
+
+  bool has_next() { return p <= dim; }
+
+  diameter_entry_t<value_t, Entry> next() {
+    const index_t_ripser v = vertices[p], k = dim + 1 - p;
+    idx_below -= binomial_coeff(v, k);
+    const index_t_ripser face_index = idx_above + idx_below;
+    idx_above += binomial_coeff(v, k - 1);
+
+    value_t face_diameter = 0;
+    for (index_t_ripser i = 0; i <= dim; ++i)
+      for (index_t_ripser j = 0; j < i; ++j)
+        if (i != p && j != p) face_diameter = std::max(face_diameter, dist(vertices[i], vertices[j]));
+
+    coefficient_t_ripser face_coefficient = (k - 1) & 1 ? modulus - get_coefficient(simplex) : get_coefficient(simplex);
+    ++p;
+    return diameter_entry_t<value_t, Entry>(face_diameter, face_index, face_coefficient);
+  }
+};
+
+// enumerates the simplices of dimension dim with largest vertex top and diameter at most threshold, in decreasing
+// lexicographic order of their vertices; each simplex extends a shorter vertex tuple by a smaller vertex, and every
+// tuple keeps its index and diameter, so an extension only reads the distances from its new vertex and no index is
+// ever decoded into vertices
+template <class DistanceMatrix> class simplex_extension_enumerator {
+  typedef typename DistanceMatrix::value_type value_t;
+
+  private:
+    const value_t threshold;
+  const binomial_coeff_table& binomial_coeff;
+  const DistanceMatrix& dist;
+  const index_t_ripser num_vertices;
+  // the tuple of the first j + 1 vertices has diameter prefix_diameter[j] and index prefix_index[j]
+  std::vector<index_t_ripser> vertices;
+  std::vector<value_t> prefix_diameter;
+  std::vector<index_t_ripser> prefix_index;
+  index_t_ripser level;
+
+  public:
+    simplex_extension_enumerator(index_t_ripser top, index_t_ripser dim, value_t _threshold, const DistanceMatrix& _dist,
+                                 const binomial_coeff_table& _binomial_coeff)
+  : threshold(_threshold), binomial_coeff(_binomial_coeff), dist(_dist), num_vertices(dim + 1), vertices(dim + 1, top),
+  prefix_diameter(dim + 1, 0), prefix_index(dim + 1), level(1) {
+    assert(dim > 0);
+    prefix_index[0] = binomial_coeff(top, num_vertices);
+  }
+
+  // moves to the next simplex, returning false once there are none left
+  bool next() {
+    index_t_ripser j = level;
+    while (j > 0) {
+      // the vertex at level j is the (num_vertices - j)-th smallest, so it needs that many vertices below it
+      if (--vertices[j] < num_vertices - 1 - j) {
+        --j;
+        continue;
+      }
+      value_t diameter = prefix_diameter[j - 1];
+      for (index_t_ripser i = 0; i < j && diameter <= threshold; ++i)
+        diameter = std::max(diameter, dist(vertices[j], vertices[i]));
+      if (diameter > threshold) continue;
+
+      prefix_diameter[j] = diameter;
+      prefix_index[j] = prefix_index[j - 1] + binomial_coeff(vertices[j], num_vertices - j);
+      if (j + 1 == num_vertices) {
+        level = j;
+        return true;
+      }
+      ++j;
+      vertices[j] = vertices[j - 1];
+    }
+    level = 0;
+    return false;
+  }
+
+  index_t_ripser index() const { return prefix_index[num_vertices - 1]; }
+  value_t diameter() const { return prefix_diameter[num_vertices - 1]; }
+  // in decreasing order, as get_simplex_vertices gives them
+  const std::vector<index_t_ripser>& simplex_vertices() const { return vertices; }
+};
+
+// the delay embedding of a time series, without storing it: point i is (series[i], series[i + lag], ...,
+// series[i + (dim - 1) * lag]), and its distances are those of the embedded points
+class delay_embedding {
+  public:
+    typedef value_t_ripser value_type;
+
+  std::vector<value_t_ripser> series;
+  index_t_ripser dim, lag;
+
+  delay_embedding(std::vector<value_t_ripser>&& _series, index_t_ripser _dim, index_t_ripser _lag)
+  : series(std::move(_series)), dim(_dim), lag(_lag) {}
+
+  value_t_ripser squared_distance(const index_t_ripser i, const index_t_ripser j) const {
+    value_t_ripser s = 0;
+    for (index_t_ripser k = 0; k < dim * lag; k += lag) {
+      value_t_ripser d = series[i + k] - series[j + k];
+      s += d * d;
+    }
+    return s;
+  }
+
+  value_t_ripser operator()(const index_t_ripser i, const index_t_ripser j) const {
+    return std::sqrt(squared_distance(i, j));
+  }
+
+  size_t size() const { return series.size() - (dim - 1) * lag; }
+
+  double bytes() const { return vector_bytes(series); }
+};
+
 enum compressed_matrix_layout { LOWER_TRIANGULAR, UPPER_TRIANGULAR };
 
-template <compressed_matrix_layout Layout> class compressed_distance_matrix {
+// rows point either into the owned distances or, for a view, into memory owned elsewhere (e.g. an R vector)
+// that must outlive the matrix; a view leaves distances empty
+template <compressed_matrix_layout Layout, typename ValueType = value_t_ripser> class compressed_distance_matrix {
   public:
-    std::vector<value_t_ripser> distances;
-  std::vector<value_t_ripser*> rows;
+    typedef ValueType value_type;
 
-  void init_rows();
+  std::vector<ValueType> distances;
+  std::vector<const ValueType*> rows;
 
-  compressed_distance_matrix(std::vector<value_t_ripser>&& _distances)
-  : distances(_distances), rows((1 + std::sqrt(1 + 8 * distances.size())) / 2) {
+  compressed_distance_matrix(std::vector<ValueType>&& _distances)
+  : distances(std::move(_distances)), rows((1 + std::sqrt(1 + 8 * distances.size())) / 2) {
     assert(distances.size() == size() * (size() - 1) / 2);
-    init_rows();
+    init_rows(distances.data());
+  }
+
+  // non-owning view over num_distances values stored in the layout's order
+  compressed_distance_matrix(const ValueType* _distances, size_t num_distances)
+  : rows((1 + std::sqrt(1 + 8 * num_distances)) / 2) {
+    assert(num_distances == size() * (size() - 1) / 2);
+    init_rows(_distances);
   }
 
   template <typename DistanceMatrix>
-    compressed_distance_matrix(const DistanceMatrix& mat)
-  : distances(mat.size() * (mat.size() - 1) / 2), rows(mat.size()) {
-    init_rows();
+    compressed_distance_matrix(const DistanceMatrix& mat) : rows(mat.size()) {
+    distances.reserve(num_distances());
+    const index_t_ripser n = size();
+    for (index_t_ripser i = 0; i < n; ++i)
+      if (Layout == LOWER_TRIANGULAR)
+        for (index_t_ripser j = 0; j < i; ++j) distances.push_back(mat(i, j));
+      else
+        for (index_t_ripser j = i + 1; j < n; ++j) distances.push_back(mat(i, j));
+    init_rows(distances.data());
+  }
 
-    for (index_t_ripser i = 1; i < size(); ++i)
-      for (index_t_ripser j = 0; j < i; ++j) rows[i][j] = mat(i, j);
+  // row i of the lower layout holds the distances to vertices j < i, row i of the upper layout those to j > i
+  void init_rows(const ValueType* pointer) {
+    const index_t_ripser n = size();
+    if (Layout == LOWER_TRIANGULAR) {
+      for (index_t_ripser i = 1; i < n; ++i) {
+        rows[i] = pointer;
+        pointer += i;
+      }
+    } else {
+      pointer -= 1;
+      for (index_t_ripser i = 0; i + 1 < n; ++i) {
+        rows[i] = pointer;
+        pointer += n - i - 2;
+      }
+    }
   }
 
-  value_t_ripser operator()(const index_t_ripser i, const index_t_ripser j) const;
+  ValueType operator()(index_t_ripser i, index_t_ripser j) const {
+    if (i > j) std::swap(i, j);
+    if (i == j) return 0;
+    return Layout == LOWER_TRIANGULAR ? rows[j][i] : rows[i][j];
+  }
 
   size_t size() const { return rows.size(); }
+
+  size_t num_distances() const { return size() * (size() - 1) / 2; }
+
+  // a view holds only its rows
+  double bytes() const { return vector_bytes(distances) + vector_bytes(rows); }
 };
 
-template <> void compressed_distance_matrix<LOWER_TRIANGULAR>::init_rows() {
-  value_t_ripser* pointer = &distances[0];
-  for (index_t_ripser i = 1; i < size(); ++i) {
-    rows[i] = pointer;
-    pointer += i;
+template <typename ValueType>
+  using compressed_lower_distance_matrix = compressed_distance_matrix<LOWER_TRIANGULAR, ValueType>;
+template <typename ValueType>
+  using compressed_upper_distance_matrix = compressed_distance_matrix<UPPER_TRIANGULAR, ValueType>;
+
+// number of simplices a thread takes at a time when assembling the columns to reduce
+static const size_t assembly_chunk_size = 256;
+
+// four independent partial sums keep the loop free of a serial dependency, so it vectorizes
+inline value_t_ripser squared_euclidean_distance(const value_t_ripser* x, const value_t_ripser* y, index_t_ripser dim) {
+  value_t_ripser s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  index_t_ripser k = 0;
+  for (; k + 4 <= dim; k += 4) {
+    value_t_ripser d0 = x[k] - y[k], d1 = x[k + 1] - y[k + 1], d2 = x[k + 2] - y[k + 2], d3 = x[k + 3] - y[k + 3];
+    s0 += d0 * d0;
+    s1 += d1 * d1;
+    s2 += d2 * d2;
+    s3 += d3 * d3;
   }
+  for (; k < dim; ++k) {
+    value_t_ripser d = x[k] - y[k];
+    s0 += d * d;
+  }
+  return (s0 + s1) + (s2 + s3);
 }
 
-template <> void compressed_distance_matrix<UPPER_TRIANGULAR>::init_rows() {
-  value_t_ripser* pointer = &distances[0] - 1;
-  for (index_t_ripser i = 0; i < size() - 1; ++i) {
-    rows[i] = pointer;
-    pointer += size() - i - 2;
+inline value_t_ripser manhattan_distance(const value_t_ripser* x, const value_t_ripser* y, index_t_ripser dim) {
+  value_t_ripser s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  index_t_ripser k = 0;
+  for (; k + 4 <= dim; k += 4) {
+    s0 += std::abs(x[k] - y[k]);
+    s1 += std::abs(x[k + 1] - y[k + 1]);
+    s2 += std::abs(x[k + 2] - y[k + 2]);
+    s3 += std::abs(x[k + 3] - y[k + 3]);
   }
+  for (; k < dim; ++k) s0 += std::abs(x[k] - y[k]);
+  return (s0 + s1) + (s2 + s3);
 }
 
-template <> value_t_ripser compressed_distance_matrix<UPPER_TRIANGULAR>::operator()(index_t_ripser i, index_t_ripser j) const {
-  if (i > j) std::swap(i, j);
-  return i == j ? 0 : rows[i][j];
+inline value_t_ripser maximum_distance(const value_t_ripser* x, const value_t_ripser* y, index_t_ripser dim) {
+  value_t_ripser m0 = 0, m1 = 0, m2 = 0, m3 = 0;
+  index_t_ripser k = 0;
+  for (; k + 4 <= dim; k += 4) {
+    m0 = std::max(m0, std::abs(x[k] - y[k]));
+    m1 = std::max(m1, std::abs(x[k + 1] - y[k + 1]));
+    m2 = std::max(m2, std::abs(x[k + 2] - y[k + 2]));
+    m3 = std::max(m3, std::abs(x[k + 3] - y[k + 3]));
+  }
+  for (; k < dim; ++k) m0 = std::max(m0, std::abs(x[k] - y[k]));
+  return std::max(std::max(m0, m1), std::max(m2, m3));
 }
 
-template <> value_t_ripser compressed_distance_matrix<LOWER_TRIANGULAR>::operator()(index_t_ripser i, index_t_ripser j) const {
-  if (i > j) std::swap(i, j);
-  return i == j ? 0 : rows[j][i];
+inline value_t_ripser dot_product(const value_t_ripser* x, const value_t_ripser* y, index_t_ripser dim) {
+  value_t_ripser s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  index_t_ripser k = 0;
+  for (; k + 4 <= dim; k += 4) {
+    s0 += x[k] * y[k];
+    s1 += x[k + 1] * y[k + 1];
+    s2 += x[k + 2] * y[k + 2];
+    s3 += x[k + 3] * y[k + 3];
+  }
+  for (; k < dim; ++k) s0 += x[k] * y[k];
+  return (s0 + s1) + (s2 + s3);
 }
 
-typedef compressed_distance_matrix<LOWER_TRIANGULAR> compressed_lower_distance_matrix;
-typedef compressed_distance_matrix<UPPER_TRIANGULAR> compressed_upper_distance_matrix;
+// MAXIMUM is the Chebyshev distance; COSINE is one minus the cosine of the angle between two points and CORRELATION
+// one minus their Pearson correlation, which is the cosine distance of the points once each is centered on its mean
+enum point_cloud_metric { EUCLIDEAN, MANHATTAN, MAXIMUM, COSINE, CORRELATION };
 
-class euclidean_distance_matrix {
+// points are stored row-major in a single buffer, one point of `dim` coordinates after the other; for COSINE and
+// CORRELATION each point is centered (CORRELATION only) and scaled to norm 1 once, so that every distance is a
+// single dot product, and a point of norm 0 is at distance 1 from every other point
+template <point_cloud_metric Metric> class point_cloud_distance_matrix {
   public:
-    std::vector<std::vector<value_t_ripser>> points;
-
-  euclidean_distance_matrix(std::vector<std::vector<value_t_ripser>>&& _points) : points(_points) {}
+    typedef value_t_ripser value_type;
+
+  std::vector<value_t_ripser> points;
+  index_t_ripser dim;
+
+  point_cloud_distance_matrix(std::vector<value_t_ripser>&& _points, index_t_ripser _dim)
+  : points(std::move(_points)), dim(_dim) {
+    if (Metric == COSINE || Metric == CORRELATION) {
+      for (index_t_ripser i = 0; i < index_t_ripser(size()); ++i) {
+        value_t_ripser* point = &points[i * dim];
+        if (Metric == CORRELATION) {
+          const value_t_ripser mean = std::accumulate(point, point + dim, value_t_ripser()) / dim;
+          for (index_t_ripser k = 0; k < dim; ++k) point[k] -= mean;
+        }
+        const value_t_ripser norm = std::sqrt(dot_product(point, point, dim));
+        for (index_t_ripser k = 0; k < dim; ++k) point[k] = norm > 0 ? point[k] / norm : 0;
+      }
+    }
+  }
 
   value_t_ripser operator()(const index_t_ripser i, const index_t_ripser j) const {
-    return std::sqrt(std::inner_product(points[i].begin(), points[i].end(), points[j].begin(), value_t_ripser(),
-                                        std::plus<value_t_ripser>(),
-                                        [](value_t_ripser u, value_t_ripser v) { return (u - v) * (u - v); }));
+    switch (Metric) {
+      case MANHATTAN:
+        return manhattan_distance(&points[i * dim], &points[j * dim], dim);
+      case MAXIMUM:
+        return maximum_distance(&points[i * dim], &points[j * dim], dim);
+      case COSINE:
+      case CORRELATION:
+        // a point is at distance 0 from itself, whatever its norm
+        return i == j ? 0 : std::max<value_t_ripser>(1 - dot_product(&points[i * dim], &points[j * dim], dim), 0);
+      default:
+        return std::sqrt(squared_euclidean_distance(&points[i * dim], &points[j * dim], dim));
+    }
   }
 
-  size_t size() const { return points.size(); }
+  size_t size() const { return dim == 0 ? 0 : points.size() / dim; }
+
+  double bytes() const { return vector_bytes(points); }
+};
+
+typedef point_cloud_distance_matrix<EUCLIDEAN> euclidean_distance_matrix;
+
+// splits the rows of an n x n lower triangle into blocks holding about the same number of entries
+// and calls f(row_begin, row_end) for each block on its own thread
+template <typename Function> void parallel_for_lower_triangle(index_t_ripser n, int num_threads, Function f) {
+  num_threads = std::max<index_t_ripser>(1, std::min<index_t_ripser>(num_threads, n / 2));
+  if (num_threads == 1) {
+    f(index_t_ripser(0), n);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  index_t_ripser row_begin = 0;
+  for (int t = 1; t <= num_threads; ++t) {
+    index_t_ripser row_end = (t == num_threads) ? n : index_t_ripser(n * std::sqrt(double(t) / num_threads));
+    threads.emplace_back(f, row_begin, row_end);
+    row_begin = row_end;
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+// hands out chunks of [0, count) on demand and calls f(begin, end, thread) for each, so threads that finish
+// early take over the remaining chunks; the first exception thrown by a worker is rethrown on the caller
+template <typename Function>
+  void parallel_for_chunks(size_t count, size_t chunk_size, int num_threads, Function f) {
+  num_threads = std::max<size_t>(1, std::min<size_t>(num_threads, (count + chunk_size - 1) / chunk_size));
+  if (num_threads == 1) {
+    f(size_t(0), count, 0);
+    return;
+  }
+
+  std::atomic<size_t> next_chunk(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&](int thread) {
+    try {
+      for (size_t begin; (begin = next_chunk.fetch_add(chunk_size)) < count;)
+        f(begin, std::min(count, begin + chunk_size), thread);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) error = std::current_exception();
+      next_chunk = count;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; ++t) threads.emplace_back(worker, t);
+  worker(0);
+  for (auto& thread : threads) thread.join();
+  if (error) std::rethrow_exception(error);
+}
+
+// sorts one block per thread, then merges neighboring blocks pairwise until one is left
+template <typename T, typename Compare> void parallel_sort(std::vector<T>& v, Compare comp, int num_threads) {
+  size_t num_blocks = std::max<size_t>(1, std::min<size_t>(num_threads, v.size() / 4096));
+  if (num_blocks == 1) {
+    std::sort(v.begin(), v.end(), comp);
+    return;
+  }
+
+  std::vector<size_t> bounds(num_blocks + 1);
+  for (size_t k = 0; k <= num_blocks; ++k) bounds[k] = v.size() * k / num_blocks;
+
+  parallel_for_chunks(num_blocks, 1, num_threads, [&](size_t begin, size_t end, int) {
+    for (size_t k = begin; k < end; ++k) std::sort(v.begin() + bounds[k], v.begin() + bounds[k + 1], comp);
+  });
+  for (size_t width = 1; width < num_blocks; width *= 2) {
+    size_t num_merges = (num_blocks + 2 * width - 1) / (2 * width);
+    parallel_for_chunks(num_merges, 1, num_threads, [&](size_t begin, size_t end, int) {
+      for (size_t m = begin; m < end; ++m) {
+        size_t first = 2 * width * m, middle = std::min(num_blocks, first + width),
+          last = std::min(num_blocks, first + 2 * width);
+        std::inplace_merge(v.begin() + bounds[first], v.begin() + bounds[middle], v.begin() + bounds[last], comp);
+      }
+    });
+  }
+}
+
+// completes neighbor lists holding only the smaller neighbors of each vertex, sorted by vertex, with the larger ones;
+// these arrive in increasing order as well, so every list stays sorted by vertex
+template <typename ValueType>
+  void add_larger_neighbors(std::vector<std::vector<diameter_index_t<ValueType>>>& neighbors) {
+  // the pushes for row i only reach rows below it, whose smaller neighbors have already been read
+  for (index_t_ripser i = 0; i < index_t_ripser(neighbors.size()); ++i)
+    for (size_t k = 0, num_smaller = neighbors[i].size(); k < num_smaller; ++k)
+      neighbors[get_index(neighbors[i][k])].push_back(std::make_pair(get_diameter(neighbors[i][k]), i));
+}
+
+template <typename ValueType = value_t_ripser> class sparse_distance_matrix {
+  public:
+    typedef ValueType value_type;
+
+  std::vector<std::vector<diameter_index_t<ValueType>>> neighbors;
+
+  // keeps only the pairs at or below threshold; each neighbor list is sorted by vertex; the threads fill the smaller
+  // neighbors of their rows, and the larger ones are added afterwards
+  template <typename DistanceMatrix>
+    sparse_distance_matrix(const DistanceMatrix& mat, ValueType threshold, int num_threads = 1)
+  : neighbors(mat.size()) {
+    parallel_for_lower_triangle(size(), num_threads, [&](index_t_ripser row_begin, index_t_ripser row_end) {
+      for (index_t_ripser i = row_begin; i < row_end; ++i)
+        for (index_t_ripser j = 0; j < i; ++j) {
+          ValueType d = mat(i, j);
+          if (d <= threshold) neighbors[i].push_back(std::make_pair(d, j));
+        }
+    });
+    add_larger_neighbors(neighbors);
+  }
+
+  // takes neighbor lists that are already sorted by vertex and symmetric, e.g. those of a collapsed filtration
+  explicit sparse_distance_matrix(std::vector<std::vector<diameter_index_t<ValueType>>>&& _neighbors)
+  : neighbors(std::move(_neighbors)) {}
+
+  // binary search in the neighbor list; pairs above the threshold are at infinite distance
+  ValueType operator()(const index_t_ripser i, const index_t_ripser j) const {
+    if (i == j) return 0;
+    auto neighbor = std::lower_bound(neighbors[i].begin(), neighbors[i].end(), j,
+                                     [](const diameter_index_t<ValueType>& a, index_t_ripser b) {
+                                       return get_index(a) < b;
+                                     });
+    return (neighbor != neighbors[i].end() && get_index(*neighbor) == j) ? get_diameter(*neighbor)
+                                                                          : std::numeric_limits<ValueType>::infinity();
+  }
+
+  size_t size() const { return neighbors.size(); }
+
+  double bytes() const {
+    double total = vector_bytes(neighbors);
+    for (const auto& vertex_neighbors : neighbors) total += vector_bytes(vertex_neighbors);
+    return total;
+  }
+};
+
+template <typename ValueType, typename Entry> class simplex_coboundary_enumerator<sparse_distance_matrix<ValueType>, Entry> {
+  private:
+    const diameter_entry_t<ValueType, Entry> simplex;
+  index_t_ripser idx_below, idx_above, k;
+  const coefficient_t_ripser modulus;
+  const binomial_coeff_table& binomial_coeff;
+  const sparse_distance_matrix<ValueType>& dist;
+  std::vector<index_t_ripser> vertices;
+  std::vector<typename std::vector<diameter_index_t<ValueType>>::const_reverse_iterator> neighbor_it, neighbor_end;
+  diameter_index_t<ValueType> neighbor;
+
+  public:
+    simplex_coboundary_enumerator(const diameter_entry_t<ValueType, Entry> _simplex, index_t_ripser _dim, index_t_ripser _n,
+                                  const coefficient_t_ripser _modulus, const sparse_distance_matrix<ValueType>& _dist,
+                                  const binomial_coeff_table& _binomial_coeff,
+                                  const std::vector<index_t_ripser>* _vertices = nullptr)
+  : simplex(_simplex), idx_below(get_index(_simplex)), idx_above(0), k(_dim + 1), modulus(_modulus),
+  binomial_coeff(_binomial_coeff), dist(_dist), vertices(_dim + 1) {
+    // vertices in increasing order, so vertices[k - 1] is the largest one below the current neighbor
+    if (_vertices)
+      vertices.assign(_vertices->rbegin(), _vertices->rend());
+    else
+      get_simplex_vertices(get_index(_simplex), _dim, _n, binomial_coeff, vertices.rbegin());
+    for (index_t_ripser w : vertices) {
+      neighbor_it.push_back(dist.neighbors[w].rbegin());
+      neighbor_end.push_back(dist.neighbors[w].rend());
+    }
+  }
+
+  // walks the neighbor lists of all vertices in decreasing order, stopping at common neighbors
+  bool has_next(bool all_cofaces = true) {
+    for (auto &it0 = neighbor_it[0], &end0 = neighbor_end[0]; it0 != end0; ++it0) {
+      neighbor = *it0;
+      for (size_t idx = 1; idx < neighbor_it.size(); ++idx) {
+        auto &it = neighbor_it[idx], end = neighbor_end[idx];
+        while (get_index(*it) > get_index(neighbor))
+          if (++it == end) return false;
+        if (get_index(*it) != get_index(neighbor))
+          goto continue_outer;
+        else
+          neighbor = std::max(neighbor, *it);
+      }
+      while (k > 0 && vertices[k - 1] > get_index(neighbor)) {
+        if (!all_cofaces) return false;
+        idx_below -= binomial_coeff(vertices[k - 1], k);
+        idx_above += binomial_coeff(vertices[k - 1], k + 1);
+        --k;
+      }
+      return true;
+      continue_outer:;
+    }
+    return false;
+  }
+
+  diameter_entry_t<ValueType, Entry> next() {
+    ++neighbor_it[0];
+    ValueType coface_diameter = std::max(get_diameter(simplex), get_diameter(neighbor));
+    coefficient_t_ripser coface_coefficient = k & 1 ? modulus - get_coefficient(simplex) : get_coefficient(simplex);
+    return diameter_entry_t<ValueType, Entry>(coface_diameter, idx_above + binomial_coeff(get_index(neighbor), k + 1) + idx_below,
+                            coface_coefficient);
+  }
 };
 
 class union_find {
@@ -364,6 +910,8 @@ class union_find {
     }
     return z;
   }
+  double bytes() const { return vector_bytes(parent) + vector_bytes(rank); }
+
   void link(index_t_ripser x, index_t_ripser y) {
     x = find(x);
     y = find(y);
@@ -377,17 +925,20 @@ class union_find {
   }
 };
 
-template <typename Heap> diameter_entry_t pop_pivot(Heap& column, coefficient_t_ripser modulus) {
+// adds up the coefficients of the top entries with the same index and returns their sum, skipping sums that vanish
+template <typename Heap> typename Heap::value_type pop_pivot(Heap& column, coefficient_t_ripser modulus) {
+  typedef typename Heap::value_type diameter_entry;
+
   if (column.empty())
-    return diameter_entry_t(-1);
+    return diameter_entry(-1);
   else {
     auto pivot = column.top();
     column.pop();
     while (!column.empty() && get_index(column.top()) == get_index(pivot)) {
+      coefficient_t_ripser sum = add_coefficient(pivot, column.top(), modulus);
       column.pop();
-      if (column.empty())
-        return diameter_entry_t(-1);
-      else {
+      if (sum == 0) {
+        if (column.empty()) return diameter_entry(-1);
         pivot = column.top();
         column.pop();
       }
@@ -396,12 +947,73 @@ template <typename Heap> diameter_entry_t pop_pivot(Heap& column, coefficient_t_
   }
 }
 
-template <typename Heap> diameter_entry_t get_pivot(Heap& column, coefficient_t_ripser modulus) {
-  diameter_entry_t result = pop_pivot(column, modulus);
+template <typename Heap> typename Heap::value_type get_pivot(Heap& column, coefficient_t_ripser modulus) {
+  typename Heap::value_type result = pop_pivot(column, modulus);
   if (get_index(result) != -1) column.push(result);
   return result;
 }
 
+// a heap that compacts itself below this many entries would spend more time sorting than it saves
+static const size_t min_heap_compaction_size = 4096;
+
+// binary heap over a vector that keeps its capacity when cleared, so a single heap serves every column of a
+// dimension; once it grows to twice its size after the last compaction, compact() adds up the entries that
+// share an index, exactly as pop_pivot would, and drops those that sum to zero
+template <typename Entry, typename Compare> class column_heap {
+  std::vector<Entry> entries;
+  Compare comp;
+  size_t compaction_size;
+
+  public:
+    typedef Entry value_type;
+
+  column_heap() : compaction_size(min_heap_compaction_size) {}
+
+  bool empty() const { return entries.empty(); }
+  size_t size() const { return entries.size(); }
+  const Entry& top() const { return entries.front(); }
+  double bytes() const { return vector_bytes(entries); }
+
+  void push(const Entry& e) {
+    entries.push_back(e);
+    std::push_heap(entries.begin(), entries.end(), comp);
+  }
+
+  void pop() {
+    std::pop_heap(entries.begin(), entries.end(), comp);
+    entries.pop_back();
+  }
+
+  void clear() {
+    entries.clear();
+    compaction_size = min_heap_compaction_size;
+  }
+
+  void compact(coefficient_t_ripser modulus) {
+    if (entries.size() < compaction_size) return;
+
+    // entries with equal indices have equal diameters, so sorting makes them adjacent
+    std::sort(entries.begin(), entries.end(), comp);
+    size_t kept = 0;
+    for (size_t run = 0, next; run < entries.size(); run = next) {
+      Entry sum = entries[run];
+      bool vanished = false;
+      for (next = run + 1; next < entries.size() && get_index(entries[next]) == get_index(entries[run]); ++next) {
+        // after a zero sum, start over from the next entry, as pop_pivot does
+        if (vanished) {
+          sum = entries[next];
+          vanished = false;
+        } else
+          vanished = add_coefficient(sum, entries[next], modulus) == 0;
+      }
+      if (!vanished) entries[kept++] = sum;
+    }
+    entries.resize(kept);
+    std::make_heap(entries.begin(), entries.end(), comp);
+    compaction_size = std::max(min_heap_compaction_size, 2 * kept);
+  }
+};
+
 template <typename ValueType> class compressed_sparse_matrix {
   std::vector<size_t> bounds;
   std::vector<ValueType> entries;
@@ -409,6 +1021,8 @@ template <typename ValueType> class compressed_sparse_matrix {
   public:
     size_t size() const { return bounds.size(); }
 
+  double bytes() const { return vector_bytes(bounds) + vector_bytes(entries); }
+
   typename std::vector<ValueType>::const_iterator cbegin(size_t index) const {
     assert(index < size());
     return index == 0 ? entries.cbegin() : entries.cbegin() + bounds[index - 1];
@@ -443,117 +1057,588 @@ template <typename ValueType> class compressed_sparse_matrix {
   }
 };
 
-template <typename Heap> void push_entry(Heap& column, index_t_ripser i, coefficient_t_ripser c, value_t_ripser diameter) {
+template <typename Heap, typename ValueType>
+  void push_entry(Heap& column, index_t_ripser i, coefficient_t_ripser c, ValueType diameter) {
   entry_t e = make_entry(i, c);
   column.push(std::make_pair(diameter, e));
 }
 
-template <typename Comparator>
-  void assemble_columns_to_reduce(std::vector<diameter_index_t>& columns_to_reduce,
-                                  hash_map<index_t_ripser, index_t_ripser>& pivot_column_index, const Comparator& comp, index_t_ripser dim,
-                                  index_t_ripser n, value_t_ripser threshold, const binomial_coeff_table& binomial_coeff) {
-    index_t_ripser num_simplices = binomial_coeff(n, dim + 2);
+// the facet of the same diameter that comes first in the filtration order, or -1 if there is none
+template <typename DistanceMatrix, typename Entry, typename ValueType = typename DistanceMatrix::value_type>
+  diameter_entry_t<ValueType, Entry> get_zero_pivot_facet(const diameter_entry_t<ValueType, Entry> simplex,
+                                                          index_t_ripser dim, index_t_ripser n, coefficient_t_ripser modulus,
+                                                          const DistanceMatrix& dist,
+                                                          const binomial_coeff_table& binomial_coeff,
+                                                          const std::vector<index_t_ripser>* vertices = nullptr) {
+    simplex_boundary_enumerator<DistanceMatrix, Entry> facets(simplex, dim, n, modulus, dist, binomial_coeff, vertices);
+    while (facets.has_next()) {
+      diameter_entry_t<ValueType, Entry> facet = facets.next();
+      if (get_diameter(facet) == get_diameter(simplex)) return facet;
+    }
+    return diameter_entry_t<ValueType, Entry>(-1);
+  }
 
-    columns_to_reduce.clear();
+// the cofacet of the same diameter that is the pivot of the coboundary, or -1 if there is none
+template <typename DistanceMatrix, typename Entry, typename ValueType = typename DistanceMatrix::value_type>
+  diameter_entry_t<ValueType, Entry> get_zero_pivot_cofacet(const diameter_entry_t<ValueType, Entry> simplex,
+                                                            index_t_ripser dim, index_t_ripser n, coefficient_t_ripser modulus,
+                                                            const DistanceMatrix& dist,
+                                                            const binomial_coeff_table& binomial_coeff,
+                                                            const std::vector<index_t_ripser>* vertices = nullptr) {
+    simplex_coboundary_enumerator<DistanceMatrix, Entry> cofacets(simplex, dim, n, modulus, dist, binomial_coeff,
+                                                                  vertices);
+    while (cofacets.has_next()) {
+      diameter_entry_t<ValueType, Entry> cofacet = cofacets.next();
+      if (get_diameter(cofacet) == get_diameter(simplex)) return cofacet;
+    }
+    return diameter_entry_t<ValueType, Entry>(-1);
+  }
+
+// a simplex and its zero pivot facet form a zero-persistence apparent pair if each is the other's zero pivot
+template <typename DistanceMatrix, typename Entry, typename ValueType = typename DistanceMatrix::value_type>
+  diameter_entry_t<ValueType, Entry> get_zero_apparent_facet(const diameter_entry_t<ValueType, Entry> simplex,
+                                                             index_t_ripser dim, index_t_ripser n, coefficient_t_ripser modulus,
+                                                             const DistanceMatrix& dist,
+                                                             const binomial_coeff_table& binomial_coeff,
+                                                             const std::vector<index_t_ripser>* vertices = nullptr) {
+    diameter_entry_t<ValueType, Entry> facet =
+      get_zero_pivot_facet(simplex, dim, n, modulus, dist, binomial_coeff, vertices);
+    return ((get_index(facet) != -1) &&
+            (get_index(get_zero_pivot_cofacet(facet, dim - 1, n, modulus, dist, binomial_coeff)) == get_index(simplex)))
+      ? facet
+      : diameter_entry_t<ValueType, Entry>(-1);
+  }
 
-    for (index_t_ripser index = 0; index < num_simplices; ++index) {
-      if (pivot_column_index.find(index) == pivot_column_index.end()) {
-        value_t_ripser diameter = comp.diameter(index);
-        if (diameter <= threshold) columns_to_reduce.push_back(std::make_pair(diameter, index));
+template <typename DistanceMatrix, typename Entry, typename ValueType = typename DistanceMatrix::value_type>
+  diameter_entry_t<ValueType, Entry> get_zero_apparent_cofacet(const diameter_entry_t<ValueType, Entry> simplex,
+                                                               index_t_ripser dim, index_t_ripser n, coefficient_t_ripser modulus,
+                                                               const DistanceMatrix& dist,
+                                                               const binomial_coeff_table& binomial_coeff,
+                                                               const std::vector<index_t_ripser>* vertices = nullptr) {
+    diameter_entry_t<ValueType, Entry> cofacet =
+      get_zero_pivot_cofacet(simplex, dim, n, modulus, dist, binomial_coeff, vertices);
+    return ((get_index(cofacet) != -1) &&
+            (get_index(get_zero_pivot_facet(cofacet, dim + 1, n, modulus, dist, binomial_coeff)) == get_index(simplex)))
+      ? cofacet
+      : diameter_entry_t<ValueType, Entry>(-1);
+  }
+
+// such simplices never need a column: their pair is known without any reduction; vertices, if given, are those of
+// the simplex in decreasing order
+template <typename DistanceMatrix, typename Entry, typename ValueType = typename DistanceMatrix::value_type>
+  bool is_in_zero_apparent_pair(const diameter_entry_t<ValueType, Entry> simplex, index_t_ripser dim, index_t_ripser n,
+                                coefficient_t_ripser modulus, const DistanceMatrix& dist,
+                                const binomial_coeff_table& binomial_coeff,
+                                const std::vector<index_t_ripser>* vertices = nullptr) {
+    return (get_index(get_zero_apparent_cofacet(simplex, dim, n, modulus, dist, binomial_coeff, vertices)) != -1) ||
+      (get_index(get_zero_apparent_facet(simplex, dim, n, modulus, dist, binomial_coeff, vertices)) != -1);
+  }
+
+template <typename DistanceMatrix>
+  std::vector<diameter_index_t<typename DistanceMatrix::value_type>>
+  get_edges(const DistanceMatrix& dist, typename DistanceMatrix::value_type threshold,
+            const binomial_coeff_table& binomial_coeff) {
+    std::vector<diameter_index_t<typename DistanceMatrix::value_type>> edges;
+    rips_filtration_comparator<DistanceMatrix> comp(dist, 1, binomial_coeff);
+    for (index_t_ripser index = binomial_coeff(dist.size(), 2); index-- > 0;) {
+      typename DistanceMatrix::value_type diameter = comp.diameter(index);
+      if (diameter <= threshold) edges.push_back(std::make_pair(diameter, index));
+    }
+    return edges;
+  }
+
+// walks the stored rows directly, so no edge index has to be decoded
+template <typename ValueType>
+  std::vector<diameter_index_t<ValueType>> get_edges(const compressed_lower_distance_matrix<ValueType>& dist,
+                                                     ValueType threshold, const binomial_coeff_table& binomial_coeff) {
+  std::vector<diameter_index_t<ValueType>> edges;
+  if (threshold == std::numeric_limits<ValueType>::max()) edges.reserve(dist.num_distances());
+  const index_t_ripser n = dist.size();
+  for (index_t_ripser i = 1; i < n; ++i) {
+    const ValueType* row = dist.rows[i];
+    const index_t_ripser row_index = binomial_coeff(i, 2);
+    for (index_t_ripser j = 0; j < i; ++j)
+      if (row[j] <= threshold) edges.push_back(std::make_pair(row[j], row_index + j));
+  }
+  return edges;
+}
+
+template <typename ValueType>
+  std::vector<diameter_index_t<ValueType>> get_edges(const compressed_upper_distance_matrix<ValueType>& dist,
+                                                     ValueType threshold, const binomial_coeff_table& binomial_coeff) {
+  std::vector<diameter_index_t<ValueType>> edges;
+  if (threshold == std::numeric_limits<ValueType>::max()) edges.reserve(dist.num_distances());
+  const index_t_ripser n = dist.size();
+  for (index_t_ripser i = 0; i + 1 < n; ++i) {
+    const ValueType* row = dist.rows[i];
+    for (index_t_ripser j = i + 1; j < n; ++j)
+      if (row[j] <= threshold) edges.push_back(std::make_pair(row[j], binomial_coeff(j, 2) + i));
+  }
+  return edges;
+}
+
+template <typename ValueType>
+  std::vector<diameter_index_t<ValueType>> get_edges(const sparse_distance_matrix<ValueType>& dist,
+                                                     ValueType threshold, const binomial_coeff_table& binomial_coeff) {
+  std::vector<diameter_index_t<ValueType>> edges;
+  const index_t_ripser n = dist.size();
+  for (index_t_ripser i = 0; i < n; ++i)
+    for (auto neighbor : dist.neighbors[i]) {
+      index_t_ripser j = get_index(neighbor);
+      if (i > j && get_diameter(neighbor) <= threshold)
+        edges.push_back(std::make_pair(get_diameter(neighbor), binomial_coeff(i, 2) + j));
+    }
+  return edges;
+}
+
+// concatenates the columns each thread found and sorts them into the order in which they are reduced
+template <typename ValueType>
+  void collect_columns_to_reduce(std::vector<std::vector<diameter_index_t<ValueType>>>& thread_columns,
+                                 std::vector<diameter_index_t<ValueType>>& columns_to_reduce, int num_threads) {
+  columns_to_reduce.clear();
+  for (int t = 0; t < num_threads; ++t) {
+    columns_to_reduce.insert(columns_to_reduce.end(), thread_columns[t].begin(), thread_columns[t].end());
+    std::vector<diameter_index_t<ValueType>>().swap(thread_columns[t]);
+  }
+
+  // the order is a total one, so the result does not depend on how the work was distributed
+  parallel_sort(columns_to_reduce, greater_diameter_or_smaller_index<diameter_index_t<ValueType>>(), num_threads);
+}
+
+// a dense matrix has every distance at hand, so the simplices of dimension dim + 1 are enumerated directly by
+// extending vertex tuples, and neither the simplices of dimension dim nor any decoded vertices are needed; a
+// larger top vertex has more simplices below it, so the top vertices are handed out one at a time from the largest;
+// cofaces in a zero-persistence apparent pair get no column, and since that does not depend on any coefficient they
+// are Z/2 entries; dim_max only tells the sparse overload whether to keep the next simplices, so it is unnamed here
+template <typename DistanceMatrix, typename ValueType = typename DistanceMatrix::value_type>
+  void assemble_columns_to_reduce(std::vector<diameter_index_t<ValueType>>& simplices,
+                                  std::vector<diameter_index_t<ValueType>>& columns_to_reduce,
+                                  hash_map<index_t_ripser, index_t_ripser>& pivot_column_index, const DistanceMatrix& dist,
+                                  index_t_ripser dim, index_t_ripser, index_t_ripser n, ValueType threshold,
+                                  coefficient_t_ripser modulus, const binomial_coeff_table& binomial_coeff,
+                                  int num_threads) {
+  std::vector<diameter_index_t<ValueType>>().swap(simplices);
+  std::vector<std::vector<diameter_index_t<ValueType>>> thread_columns(num_threads);
+
+  parallel_for_chunks(n, 1, num_threads, [&](size_t begin, size_t end, int thread) {
+    std::vector<diameter_index_t<ValueType>>& columns = thread_columns[thread];
+
+    for (size_t c = begin; c < end; ++c) {
+      simplex_extension_enumerator<DistanceMatrix> cofaces(n - 1 - c, dim + 1, threshold, dist, binomial_coeff);
+      while (cofaces.next()) {
+        diameter_entry_t<ValueType, z2_entry_t> coface(cofaces.diameter(), cofaces.index(), 1);
+        if (pivot_column_index.find(get_index(coface)) == pivot_column_index.end() &&
+            !is_in_zero_apparent_pair(coface, dim + 1, n, modulus, dist, binomial_coeff, &cofaces.simplex_vertices()))
+          columns.push_back(std::make_pair(get_diameter(coface), get_index(coface)));
+      }
+    }
+  });
+
+  collect_columns_to_reduce(thread_columns, columns_to_reduce, num_threads);
+}
+
+// a sparse matrix only visits the cofaces of the previous dimension's simplices, which come from the neighbor
+// lists; the simplices are split into chunks across num_threads threads, each with its own output buffers
+template <typename ValueType>
+  void assemble_columns_to_reduce(std::vector<diameter_index_t<ValueType>>& simplices,
+                                  std::vector<diameter_index_t<ValueType>>& columns_to_reduce,
+                                  hash_map<index_t_ripser, index_t_ripser>& pivot_column_index,
+                                  const sparse_distance_matrix<ValueType>& dist, index_t_ripser dim,
+                                  index_t_ripser dim_max, index_t_ripser n, ValueType threshold,
+                                  coefficient_t_ripser modulus, const binomial_coeff_table& binomial_coeff,
+                                  int num_threads) {
+  std::vector<std::vector<diameter_index_t<ValueType>>> thread_simplices(num_threads), thread_columns(num_threads);
+
+  parallel_for_chunks(simplices.size(), assembly_chunk_size, num_threads, [&](size_t begin, size_t end, int thread) {
+    std::vector<diameter_index_t<ValueType>>& next_simplices = thread_simplices[thread];
+    std::vector<diameter_index_t<ValueType>>& columns = thread_columns[thread];
+
+    for (size_t s = begin; s < end; ++s) {
+      simplex_coboundary_enumerator<sparse_distance_matrix<ValueType>, z2_entry_t> cofaces(simplices[s], dim, n,
+                                                                                            modulus, dist,
+                                                                                            binomial_coeff);
+      while (cofaces.has_next(false)) {
+        diameter_entry_t<ValueType, z2_entry_t> coface = cofaces.next();
+        if (get_diameter(coface) <= threshold) {
+          if (dim + 1 < dim_max) next_simplices.push_back(std::make_pair(get_diameter(coface), get_index(coface)));
+          if (!is_in_zero_apparent_pair(coface, dim + 1, n, modulus, dist, binomial_coeff) &&
+              pivot_column_index.find(get_index(coface)) == pivot_column_index.end())
+            columns.push_back(std::make_pair(get_diameter(coface), get_index(coface)));
+        }
       }
     }
+  });
 
-    std::sort(columns_to_reduce.begin(), columns_to_reduce.end(),
-              greater_diameter_or_smaller_index<diameter_index_t>());
+  simplices.clear();
+  for (int t = 0; t < num_threads; ++t) {
+    simplices.insert(simplices.end(), thread_simplices[t].begin(), thread_simplices[t].end());
+    std::vector<diameter_index_t<ValueType>>().swap(thread_simplices[t]);
+  }
+  collect_columns_to_reduce(thread_columns, columns_to_reduce, num_threads);
+}
+
+template <typename DistanceMatrix, typename Column, typename Entry,
+          typename ValueType = typename DistanceMatrix::value_type>
+  void add_simplex_coboundary(const diameter_entry_t<ValueType, Entry> simplex, index_t_ripser dim, index_t_ripser n,
+                              ValueType threshold, coefficient_t_ripser modulus, const DistanceMatrix& dist,
+                              const binomial_coeff_table& binomial_coeff, Column& working_coboundary) {
+    simplex_coboundary_enumerator<DistanceMatrix, Entry> cofaces(simplex, dim, n, modulus, dist, binomial_coeff);
+    while (cofaces.has_next()) {
+      diameter_entry_t<ValueType, Entry> coface = cofaces.next();
+      if (get_diameter(coface) <= threshold) working_coboundary.push(coface);
+    }
   }
 
-template <typename DistanceMatrix, typename ComparatorCofaces, typename Comparator>
-  void compute_pairs(std::vector<diameter_index_t>& columns_to_reduce, hash_map<index_t_ripser, index_t_ripser>& pivot_column_index,
-                     index_t_ripser dim, index_t_ripser n, value_t_ripser threshold, coefficient_t_ripser modulus,
-                     const std::vector<coefficient_t_ripser>& multiplicative_inverse, const DistanceMatrix& dist,
-                     const ComparatorCofaces& comp, const Comparator& comp_prev,
+// pushes the coboundary of simplex onto working_coboundary and returns its pivot; returns early, without
+// pushing anything, if the simplex forms an emergent pair with its first coface of the same diameter
+template <typename DistanceMatrix, typename Column, typename PivotColumnIndex, typename Entry,
+          typename ValueType = typename DistanceMatrix::value_type>
+  diameter_entry_t<ValueType, Entry> init_coboundary_and_get_pivot(const diameter_entry_t<ValueType, Entry> simplex,
+                                                                   Column& working_coboundary, index_t_ripser dim,
+                                                                   index_t_ripser n, ValueType threshold,
+                                                                   coefficient_t_ripser modulus, const DistanceMatrix& dist,
+                                                                   const binomial_coeff_table& binomial_coeff,
+                                                                   const PivotColumnIndex& pivot_column_index,
+                                                                   std::vector<diameter_entry_t<ValueType, Entry>>& coface_entries) {
+    bool check_for_emergent_pair = true;
+    coface_entries.clear();
+    simplex_coboundary_enumerator<DistanceMatrix, Entry> cofaces(simplex, dim, n, modulus, dist, binomial_coeff);
+    while (cofaces.has_next()) {
+      diameter_entry_t<ValueType, Entry> coface = cofaces.next();
+      if (get_diameter(coface) <= threshold) {
+        coface_entries.push_back(coface);
+        if (check_for_emergent_pair && (get_diameter(simplex) == get_diameter(coface))) {
+          if (pivot_column_index.find(get_index(coface)) == pivot_column_index.end() &&
+              get_index(get_zero_apparent_facet(coface, dim + 1, n, modulus, dist, binomial_coeff)) == -1)
+            return coface;
+          check_for_emergent_pair = false;
+        }
+      }
+    }
+    for (auto e : coface_entries) working_coboundary.push(e);
+    return get_pivot(working_coboundary, modulus);
+  }
+
+// the persistence pairs as one column each for dimension, birth and death, which become the columns of the
+// returned data frame as they are
+struct persistence_pairs {
+  std::vector<int> dimension;
+  std::vector<value_t_ripser> birth, death;
+
+  size_t size() const { return dimension.size(); }
+
+  void reserve(size_t n) {
+    dimension.reserve(n);
+    birth.reserve(n);
+    death.reserve(n);
+  }
+
+  double bytes() const { return vector_bytes(dimension) + vector_bytes(birth) + vector_bytes(death); }
+
+  void push_back(int dim, value_t_ripser _birth, value_t_ripser _death) {
+    dimension.push_back(dim);
+    birth.push_back(_birth);
+    death.push_back(_death);
+  }
+
+  DataFrame to_data_frame() const {
+    return DataFrame::create(Named("dimension") = IntegerVector(dimension.begin(), dimension.end()),
+                             Named("birth") = NumericVector(birth.begin(), birth.end()),
+                             Named("death") = NumericVector(death.begin(), death.end()));
+  }
+};
+
+template <typename Entry, typename DistanceMatrix, typename ValueType = typename DistanceMatrix::value_type>
+  void compute_pairs(std::vector<diameter_index_t<ValueType>>& columns_to_reduce,
+                     hash_map<index_t_ripser, index_t_ripser>& pivot_column_index,
+                     index_t_ripser dim, index_t_ripser n, ValueType threshold, coefficient_t_ripser modulus,
+                     const prime_field& field, const DistanceMatrix& dist,
                      const binomial_coeff_table& binomial_coeff,
-                     std::vector<std::vector<value_t_ripser>> &pers_hom) {
+                     persistence_pairs& pers_hom) {
+    typedef diameter_entry_t<ValueType, Entry> entry;
 
     //PRINT VALUES
     int currDim = dim;
 
-    std::vector<diameter_entry_t> coface_entries;
+    std::vector<entry> coface_entries;
+
+    // both heaps are reused by every column of this dimension, keeping the capacity they grew to
+    column_heap<entry, smaller_index<entry>> reduction_column;
+    column_heap<entry, greater_diameter_or_smaller_index<entry>> working_coboundary;
+
+    // column i holds the simplices whose coboundaries sum to the reduced column i, so reducing
+    // with column j replays its whole reduction instead of starting over from simplex j
+    compressed_sparse_matrix<entry> reduction_matrix;
 
     for (index_t_ripser i = 0; i < columns_to_reduce.size(); ++i) {
-      if (i % 1000 == 0) {
+      if (i % 1000 == 0 && on_r_thread()) {
         Rcpp::checkUserInterrupt();
       }
 
-      auto column_to_reduce = columns_to_reduce[i];
-
-      std::priority_queue<diameter_entry_t, std::vector<diameter_entry_t>,
-      greater_diameter_or_smaller_index<diameter_entry_t>>
-        working_coboundary;
-
-      value_t_ripser diameter = get_diameter(column_to_reduce);
-      index_t_ripser j = i;
-
-      // start with a dummy pivot entry with coefficient -1 in order to initialize
-      // working_coboundary with the coboundary of the simplex with index column_to_reduce
-      diameter_entry_t pivot(0, -1, -1 + modulus);
-      bool might_be_apparent_pair = (i == j);
-
-      do {
-        const coefficient_t_ripser factor = modulus - get_coefficient(pivot);
-        auto coeffs_begin = &columns_to_reduce[j], coeffs_end = &columns_to_reduce[j] + 1;
-
-        for (auto it = coeffs_begin; it != coeffs_end; ++it) {
-          diameter_entry_t simplex = *it;
-          set_coefficient(simplex, get_coefficient(simplex) * factor % modulus);
-
-          coface_entries.clear();
-          simplex_coboundary_enumerator<decltype(dist)> cofaces(simplex, dim, n, modulus, dist, binomial_coeff);
-          while (cofaces.has_next()) {
-            diameter_entry_t coface = cofaces.next();
-            if (get_diameter(coface) <= threshold) {
-              coface_entries.push_back(coface);
-              if (might_be_apparent_pair && (get_diameter(simplex) == get_diameter(coface))) {
-                if (pivot_column_index.find(get_index(coface)) == pivot_column_index.end()) {
-                  pivot = coface;
-                  goto found_persistence_pair;
-                }
-                might_be_apparent_pair = false;
-              }
-            }
+      entry column_to_reduce(columns_to_reduce[i], 1);
+      ValueType diameter = get_diameter(column_to_reduce);
+
+      reduction_matrix.append_column();
+      reduction_matrix.push_back(column_to_reduce);
+
+      reduction_column.clear();
+      working_coboundary.clear();
+      reduction_column.push(column_to_reduce);
+      entry pivot =
+        init_coboundary_and_get_pivot(column_to_reduce, working_coboundary, dim, n, threshold, modulus, dist,
+                                      binomial_coeff, pivot_column_index, coface_entries);
+
+      while (get_index(pivot) != -1) {
+        auto pair = pivot_column_index.find(get_index(pivot));
+        entry e;
+
+        if (pair != pivot_column_index.end()) {
+          // add the stored reduction of the column with the same pivot
+          const coefficient_t_ripser factor = field.negate(get_coefficient(pivot));
+          index_t_ripser j = pair->second;
+          for (auto it = reduction_matrix.cbegin(j); it != reduction_matrix.cend(j); ++it) {
+            entry simplex = *it;
+            set_coefficient(simplex, field.multiply(get_coefficient(simplex), factor));
+            reduction_column.push(simplex);
+            add_simplex_coboundary(simplex, dim, n, threshold, modulus, dist, binomial_coeff, working_coboundary);
           }
-          for (auto e : coface_entries) working_coboundary.push(e);
+          reduction_column.compact(modulus);
+          working_coboundary.compact(modulus);
+          pivot = get_pivot(working_coboundary, modulus);
+        } else if (get_index(e = get_zero_apparent_facet(pivot, dim + 1, n, modulus, dist, binomial_coeff)) != -1) {
+          // the pivot is paired with a simplex that got no column; add that simplex's coboundary instead
+          set_coefficient(e, field.negate(get_coefficient(e)));
+          reduction_column.push(e);
+          add_simplex_coboundary(e, dim, n, threshold, modulus, dist, binomial_coeff, working_coboundary);
+          working_coboundary.compact(modulus);
+          pivot = get_pivot(working_coboundary, modulus);
+        } else {
+          //PRINT VALUES
+          ValueType death = get_diameter(pivot);
+          if (diameter != death) pers_hom.push_back(currDim, diameter, death);
+
+          pivot_column_index.insert(std::make_pair(get_index(pivot), i));
+
+          // replace the diagonal entry of column i by the accumulated reduction column, normalized
+          // so that the pivot of its coboundary has coefficient 1
+          const coefficient_t_ripser inverse = field.inverse(get_coefficient(pivot));
+          reduction_matrix.pop_back();
+          while (true) {
+            e = pop_pivot(reduction_column, modulus);
+            if (get_index(e) == -1) break;
+            set_coefficient(e, field.multiply(inverse, get_coefficient(e)));
+            reduction_matrix.push_back(e);
+          }
+          break;
         }
+      }
+    }
 
-        pivot = get_pivot(working_coboundary, modulus);
+    // everything here only grows while the dimension is reduced
+    phase_profile::hold(vector_bytes(columns_to_reduce) + pivot_column_index.bytes() + reduction_matrix.bytes() +
+                        reduction_column.bytes() + working_coboundary.bytes() + vector_bytes(coface_entries));
+  }
 
-        if (get_index(pivot) != -1) {
-          auto pair = pivot_column_index.find(get_index(pivot));
+// insert-only hash table, with linear probing, from a pivot to the column that currently owns it; slots are
+// claimed with compare-and-swap, and the capacity is fixed since each column owns at most one pivot at a time
+class concurrent_pivot_table {
+  public:
+    struct slot {
+      std::atomic<index_t_ripser> pivot, column;
+    };
+    typedef const slot* const_iterator;
+
+    explicit concurrent_pivot_table(size_t num_columns) : capacity(16) {
+      while (capacity < 2 * num_columns) capacity *= 2;
+      slots.reset(new slot[capacity]);
+      for (size_t s = 0; s < capacity; ++s) {
+        slots[s].pivot.store(-1, std::memory_order_relaxed);
+        slots[s].column.store(-1, std::memory_order_relaxed);
+      }
+    }
 
-          if (pair != pivot_column_index.end()) {
-            j = pair->second;
-            continue;
-          }
-        } else {
-          break;
+    const_iterator find(index_t_ripser pivot) const {
+      for (size_t s = hash_index(pivot, capacity);; s = (s + 1) & (capacity - 1)) {
+        index_t_ripser key = slots[s].pivot.load(std::memory_order_acquire);
+        if (key == pivot) return &slots[s];
+        if (key == -1) return end();
+      }
+    }
+
+    const_iterator end() const { return slots.get() + capacity; }
+
+    double bytes() const { return double(capacity) * sizeof(slot); }
+
+    // the column owning pivot, or -1 if there is none yet
+    index_t_ripser owner(index_t_ripser pivot) const {
+      const_iterator it = find(pivot);
+      return it == end() ? -1 : it->column.load(std::memory_order_acquire);
+    }
+
+    // makes column the owner of pivot if expected still is; fails if another column got there first
+    bool claim(index_t_ripser pivot, index_t_ripser expected, index_t_ripser column) {
+      for (size_t s = hash_index(pivot, capacity);; s = (s + 1) & (capacity - 1)) {
+        index_t_ripser key = -1;
+        if (slots[s].pivot.compare_exchange_strong(key, pivot, std::memory_order_acq_rel) || key == pivot)
+          return slots[s].column.compare_exchange_strong(expected, column, std::memory_order_acq_rel);
+      }
+    }
+
+    // calls f(pivot, column) for every claimed pivot; only safe once all threads are done
+    template <typename Function> void for_each(Function f) const {
+      for (size_t s = 0; s < capacity; ++s) {
+        index_t_ripser column = slots[s].column.load(std::memory_order_relaxed);
+        if (column != -1) f(slots[s].pivot.load(std::memory_order_relaxed), column);
+      }
+    }
+
+  private:
+    size_t capacity;
+    std::unique_ptr<slot[]> slots;
+};
+
+// a column of the reduction matrix as published by the thread that reduced it, normalized so that the pivot
+// of its coboundary has coefficient 1; it is never modified once published, so other threads can read it freely
+template <typename ValueType, typename Entry> struct reduced_column {
+  diameter_entry_t<ValueType, Entry> pivot;
+  std::vector<diameter_entry_t<ValueType, Entry>> simplices;
+};
+
+// number of columns a thread takes at a time in the parallel reduction
+static const size_t reduction_chunk_size = 16;
+
+// reduces the columns on num_threads threads, after the lock-free matrix reduction of Morozov and Nigmetov:
+// a column that reaches a pivot owned by an earlier column adds that column's latest published reduction,
+// and a column that takes a pivot from a later one hands the later column back for further reduction; the
+// pivot of each column at the end is the same as in the serial reduction, and so are the pairs and their order
+template <typename Entry, typename DistanceMatrix, typename ValueType = typename DistanceMatrix::value_type>
+  void compute_pairs_parallel(std::vector<diameter_index_t<ValueType>>& columns_to_reduce,
+                              hash_map<index_t_ripser, index_t_ripser>& pivot_column_index,
+                              index_t_ripser dim, index_t_ripser n, ValueType threshold, coefficient_t_ripser modulus,
+                              const prime_field& field, const DistanceMatrix& dist, const binomial_coeff_table& binomial_coeff,
+                              persistence_pairs& pers_hom, int num_threads) {
+    typedef diameter_entry_t<ValueType, Entry> entry;
+
+    struct thread_state {
+      column_heap<entry, smaller_index<entry>> reduction_column;
+      column_heap<entry, greater_diameter_or_smaller_index<entry>> working_coboundary;
+      std::vector<entry> coface_entries;
+      // everything this thread published; kept until all threads are done, since others may still read it
+      std::vector<std::unique_ptr<reduced_column<ValueType, Entry>>> published;
+    };
+
+    const size_t num_columns = columns_to_reduce.size();
+    concurrent_pivot_table pivot_table(num_columns);
+    std::unique_ptr<std::atomic<const reduced_column<ValueType, Entry>*>[]> reduced(
+        new std::atomic<const reduced_column<ValueType, Entry>*>[num_columns]);
+    for (size_t i = 0; i < num_columns; ++i) reduced[i].store(nullptr, std::memory_order_relaxed);
+    std::vector<thread_state> states(num_threads);
+
+    // reduces column i until it owns its pivot or vanishes; returns the column it took the pivot from (which
+    // needs reducing again), i itself if another column claimed the pivot first, or -1 if it is done
+    auto reduce_column = [&](index_t_ripser i, thread_state& state) -> index_t_ripser {
+      auto& reduction_column = state.reduction_column;
+      auto& working_coboundary = state.working_coboundary;
+      entry column_to_reduce(columns_to_reduce[i], 1);
+      entry pivot;
+
+      reduction_column.clear();
+      working_coboundary.clear();
+      const reduced_column<ValueType, Entry>* current = reduced[i].load(std::memory_order_acquire);
+      if (current == nullptr) {
+        reduction_column.push(column_to_reduce);
+        pivot = init_coboundary_and_get_pivot(column_to_reduce, working_coboundary, dim, n, threshold, modulus, dist,
+                                              binomial_coeff, pivot_table, state.coface_entries);
+      } else {
+        // continue from the reduction this column published before it lost its pivot
+        for (entry simplex : current->simplices) {
+          reduction_column.push(simplex);
+          add_simplex_coboundary(simplex, dim, n, threshold, modulus, dist, binomial_coeff, working_coboundary);
         }
+        pivot = get_pivot(working_coboundary, modulus);
+      }
 
-        found_persistence_pair:
+      while (get_index(pivot) != -1) {
+        index_t_ripser j = pivot_table.owner(get_index(pivot));
+        entry e;
+
+        if (j != -1 && j < i) {
+          const reduced_column<ValueType, Entry>* other = reduced[j].load(std::memory_order_acquire);
+          // column j lost the pivot after we looked it up; look again
+          if (get_index(other->pivot) != get_index(pivot)) continue;
+
+          // an emergent pair returns before the coboundary is pushed, and an earlier column has claimed its
+          // pivot in the meantime
+          if (working_coboundary.empty())
+            add_simplex_coboundary(column_to_reduce, dim, n, threshold, modulus, dist, binomial_coeff,
+                                   working_coboundary);
+
+          const coefficient_t_ripser factor = field.negate(get_coefficient(pivot));
+          for (entry simplex : other->simplices) {
+            set_coefficient(simplex, field.multiply(get_coefficient(simplex), factor));
+            reduction_column.push(simplex);
+            add_simplex_coboundary(simplex, dim, n, threshold, modulus, dist, binomial_coeff, working_coboundary);
+          }
+          reduction_column.compact(modulus);
+          working_coboundary.compact(modulus);
+          pivot = get_pivot(working_coboundary, modulus);
+        } else if (get_index(e = get_zero_apparent_facet(pivot, dim + 1, n, modulus, dist, binomial_coeff)) != -1) {
+          if (working_coboundary.empty())
+            add_simplex_coboundary(column_to_reduce, dim, n, threshold, modulus, dist, binomial_coeff,
+                                   working_coboundary);
+          set_coefficient(e, field.negate(get_coefficient(e)));
+          reduction_column.push(e);
+          add_simplex_coboundary(e, dim, n, threshold, modulus, dist, binomial_coeff, working_coboundary);
+          working_coboundary.compact(modulus);
+          pivot = get_pivot(working_coboundary, modulus);
+        } else {
+          // publish the reduction before claiming the pivot, so that whoever finds column i as the owner can
+          // read it
+          std::unique_ptr<reduced_column<ValueType, Entry>> column(new reduced_column<ValueType, Entry>());
+          column->pivot = pivot;
+          const coefficient_t_ripser inverse = field.inverse(get_coefficient(pivot));
+          while (true) {
+            e = pop_pivot(reduction_column, modulus);
+            if (get_index(e) == -1) break;
+            set_coefficient(e, field.multiply(inverse, get_coefficient(e)));
+            column->simplices.push_back(e);
+          }
+          reduced[i].store(column.get(), std::memory_order_release);
+          state.published.push_back(std::move(column));
 
-          //PRINT VALUES
-        value_t_ripser death = get_diameter(pivot);
-        if (diameter != death) {
-          std::vector<value_t_ripser> curr;
-          curr.push_back(currDim);
-          curr.push_back(diameter);
-          curr.push_back(death);
-          pers_hom.push_back(curr);
+          return pivot_table.claim(get_index(pivot), j, i) ? j : i;
         }
+      }
+      return -1;
+    };
+
+    // R's interrupt check may not be called off the main thread, so this reduction cannot be interrupted
+    parallel_for_chunks(num_columns, reduction_chunk_size, num_threads, [&](size_t begin, size_t end, int thread) {
+      for (size_t c = begin; c < end; ++c)
+        for (index_t_ripser i = c; i != -1;) i = reduce_column(i, states[thread]);
+    });
+
+    std::vector<index_t_ripser> pivot_of(num_columns, -1);
+    pivot_table.for_each([&](index_t_ripser pivot, index_t_ripser column) { pivot_of[column] = pivot; });
+
+    if (phase_profile::active() != nullptr) {
+      double num_bytes = vector_bytes(columns_to_reduce) + pivot_table.bytes() + vector_bytes(pivot_of) +
+                         double(num_columns) * sizeof(reduced[0]);
+      for (const thread_state& state : states) {
+        num_bytes += state.reduction_column.bytes() + state.working_coboundary.bytes() +
+                     vector_bytes(state.coface_entries) + vector_bytes(state.published);
+        for (const auto& column : state.published) num_bytes += sizeof(*column) + vector_bytes(column->simplices);
+      }
+      phase_profile::hold(num_bytes);
+    }
 
-        pivot_column_index.insert(std::make_pair(get_index(pivot), i));
-        break;
-      } while (true);
+    for (size_t i = 0; i < num_columns; ++i) {
+      if (pivot_of[i] == -1) continue;
+      ValueType birth = get_diameter(columns_to_reduce[i]), death = get_diameter(reduced[i].load()->pivot);
+      if (birth != death) pers_hom.push_back(dim, birth, death);
+      pivot_column_index.insert(std::make_pair(pivot_of[i], index_t_ripser(i)));
     }
+    phase_profile::hold(vector_bytes(columns_to_reduce) + pivot_column_index.bytes() + vector_bytes(pivot_of));
   }
 
 //enum file_format {POINT_CLOUD};
@@ -564,40 +1649,99 @@ template <typename T> T read(std::istream& s) {
   return result; // on little endian: boost::endian::little_to_native(result);
 }
 
-compressed_lower_distance_matrix getPointCloud(const NumericMatrix& inputMat) {
-  std::vector<std::vector<value_t_ripser>> points;
-
+// copy the column-major R matrix into a row-major buffer so each point is contiguous
+std::vector<value_t_ripser> getPoints(const NumericMatrix& inputMat) {
   int numRows = inputMat.nrow(),
   numCols = inputMat.ncol();
 
-  value_t_ripser value;
+  std::vector<value_t_ripser> points(size_t(numRows) * numCols);
+  const double* column = inputMat.begin();
 
-  for (int i = 0; i < numRows; i++) {
-    std::vector<value_t_ripser> currPoint;
-    for (int j = 0; j < numCols; j++) {
-      value = inputMat(i, j);
-      currPoint.push_back(value);
+  for (int j = 0; j < numCols; j++, column += numRows)
+    for (int i = 0; i < numRows; i++)
+      points[size_t(i) * numCols + j] = column[i];
+
+  return points;
+}
+
+// distances are computed in double precision and rounded once when stored as ValueType
+template <typename ValueType, point_cloud_metric Metric>
+  compressed_lower_distance_matrix<ValueType> getPointCloud(const point_cloud_distance_matrix<Metric>& point_dist,
+                                                            int num_threads) {
+  index_t_ripser n = point_dist.size();
+
+  std::vector<ValueType> distances(n * (n - 1) / 2);
+
+  // row i of the lower triangle starts at offset i * (i - 1) / 2
+  parallel_for_lower_triangle(n, num_threads, [&](index_t_ripser row_begin, index_t_ripser row_end) {
+    for (index_t_ripser i = row_begin; i < row_end; i++) {
+      ValueType* row = distances.data() + i * (i - 1) / 2;
+      for (index_t_ripser j = 0; j < i; j++)
+        row[j] = point_dist(i, j);
     }
-    if (!currPoint.empty())
-      points.push_back(currPoint);
-    assert(currPoint.size() == points.front().size());
-  }
+  });
 
-  euclidean_distance_matrix eucl_dist(std::move(points));
+  return compressed_lower_distance_matrix<ValueType>(std::move(distances));
+}
 
-  index_t_ripser n = eucl_dist.size();
+// point clouds with at least this many columns use the Gram matrix formulation
+static const int gram_min_dim = 64;
+// number of points per block of rows; each block costs one dgemm call against all earlier points
+static const index_t_ripser gram_block_size = 128;
+// squared distances this small relative to the norms are recomputed directly
+static const value_t_ripser gram_cancellation_tolerance = 1e-6;
 
-  std::vector<value_t_ripser> distances;
+// uses ||x||^2 + ||y||^2 - 2 x'y with the Gram block of each block of rows computed by dgemm
+// the BLAS that R links need not be thread-safe, so dgemm is only called from the calling thread
+// (a threaded BLAS parallelizes it on its own) and the workers only turn Gram entries into distances
+template <typename ValueType>
+  compressed_lower_distance_matrix<ValueType> getGramPointCloud(const euclidean_distance_matrix& eucl_dist,
+                                                                int num_threads) {
+  int numCols = eucl_dist.dim;
 
-  for (int i = 0; i < n; i++)
-    for (int j = 0; j < i; j++)
-      distances.push_back(eucl_dist(i, j));
+  // row-major n x d points are the column-major d x n matrix BLAS expects
+  const value_t_ripser* points = eucl_dist.points.data();
+
+  index_t_ripser n = eucl_dist.size();
+
+  std::vector<value_t_ripser> norms(n);
+  for (index_t_ripser i = 0; i < n; i++)
+    norms[i] = std::inner_product(points + i * numCols, points + (i + 1) * numCols, points + i * numCols,
+                                  value_t_ripser());
+
+  std::vector<ValueType> distances(n * (n - 1) / 2);
+  std::vector<value_t_ripser> gram(std::min(n, gram_block_size) * n);
+  const double one = 1, zero = 0;
+
+  for (index_t_ripser i_begin = 0; i_begin < n; i_begin += gram_block_size) {
+    index_t_ripser i_end = std::min(n, i_begin + gram_block_size);
+    int block_rows = i_end - i_begin, block_cols = i_end;
+
+    // Gram entries of the rows in the block against every point up to the end of the block
+    F77_CALL(dgemm)("T", "N", &block_rows, &block_cols, &numCols, &one, points + i_begin * numCols, &numCols,
+                    points, &numCols, &zero, gram.data(), &block_rows FCONE FCONE);
+
+    parallel_for_chunks(block_rows, 1, num_threads, [&](size_t begin, size_t end, int) {
+      for (index_t_ripser i = i_begin + begin; i < i_begin + index_t_ripser(end); i++) {
+        ValueType* row = distances.data() + i * (i - 1) / 2;
+        for (index_t_ripser j = 0; j < i; j++) {
+          value_t_ripser sq_dist = norms[i] + norms[j] - 2 * gram[j * block_rows + (i - i_begin)];
+          // cancellation leaves nearby pairs with large relative (or negative) error
+          if (sq_dist <= gram_cancellation_tolerance * (norms[i] + norms[j]))
+            row[j] = eucl_dist(i, j);
+          else
+            row[j] = std::sqrt(sq_dist);
+        }
+      }
+    });
+  }
 
-  return compressed_lower_distance_matrix(std::move(distances));
+  return compressed_lower_distance_matrix<ValueType>(std::move(distances));
 }
 
-compressed_lower_distance_matrix getLowerDistMatrix(const NumericMatrix& inputMat) {
-  std::vector<value_t_ripser> distances;
+template <typename ValueType>
+  compressed_lower_distance_matrix<ValueType> getLowerDistMatrix(const NumericMatrix& inputMat) {
+  std::vector<ValueType> distances;
   value_t_ripser value;
 
   int numRows = inputMat.nrow();
@@ -611,55 +1755,420 @@ compressed_lower_distance_matrix getLowerDistMatrix(const NumericMatrix& inputMa
     }
   }
 
-  return compressed_lower_distance_matrix(std::move(distances));
+  return compressed_lower_distance_matrix<ValueType>(std::move(distances));
 }
 
-// convert from user format into lower distance matrix
-compressed_lower_distance_matrix read_file(const NumericMatrix& input_points, int format) {
-  switch (format) {
-    case 0:
-      return getPointCloud(input_points);
-    case 1:
-      return getLowerDistMatrix(input_points);
-    default:
-      assert(0 == 1);	//error should never reach here
-    //should never reach here - but compile errors otherwise
-    return getPointCloud(input_points);
+// convert the points into a lower distance matrix
+template <typename ValueType>
+  compressed_lower_distance_matrix<ValueType> read_point_cloud(const euclidean_distance_matrix& points,
+                                                               int num_threads) {
+  if (points.dim >= gram_min_dim)
+    return getGramPointCloud<ValueType>(points, num_threads);
+  return getPointCloud<ValueType>(points, num_threads);
+}
+
+// only euclidean distances have a Gram formulation
+template <typename ValueType, point_cloud_metric Metric>
+  compressed_lower_distance_matrix<ValueType> read_point_cloud(const point_cloud_distance_matrix<Metric>& points,
+                                                               int num_threads) {
+  return getPointCloud<ValueType>(points, num_threads);
+}
+
+// rows of a delay embedding's distance matrix are computed in segments of this many rows, each on one thread; the
+// first lag rows of a segment are computed directly, which also bounds the rounding error of the recurrence
+static const index_t_ripser delay_segment_rows = 128;
+// above this lag the rows the recurrence reads back are too far apart, and every distance is computed directly
+static const index_t_ripser delay_max_recurrence_lag = 16;
+
+// consecutive points of a delay embedding share all but one coordinate, so with d(i, j) the squared distance,
+// d(i, j) = d(i - lag, j - lag) - (x[i - lag] - x[j - lag])^2 + (x[i + last] - x[j + last])^2 where
+// last = (dim - 1) * lag, and each row costs two terms per entry after the first lag rows of its segment
+template <typename ValueType>
+  compressed_lower_distance_matrix<ValueType> read_point_cloud(const delay_embedding& points, int num_threads) {
+  const index_t_ripser n = points.size(), lag = points.lag, last = (points.dim - 1) * lag;
+  const value_t_ripser* x = points.series.data();
+  const bool recurrence = lag <= delay_max_recurrence_lag;
+  const index_t_ripser num_segments = (n + delay_segment_rows - 1) / delay_segment_rows;
+
+  std::vector<ValueType> distances(n * (n - 1) / 2);
+
+  // segments do not depend on the number of threads, and neither do the distances
+  parallel_for_chunks(num_segments, 1, num_threads, [&](size_t begin, size_t end, int) {
+    // squared distances of the rows i - lag to i, row i in slot i % (lag + 1)
+    std::vector<std::vector<value_t_ripser>> squared_rows(recurrence ? lag + 1 : 1);
+
+    for (index_t_ripser segment = begin; segment < index_t_ripser(end); ++segment) {
+      const index_t_ripser segment_begin = segment * delay_segment_rows;
+      for (index_t_ripser i = segment_begin; i < std::min(n, segment_begin + delay_segment_rows); ++i) {
+        std::vector<value_t_ripser>& row = squared_rows[recurrence ? i % (lag + 1) : 0];
+        row.resize(i);
+        value_t_ripser* squared = row.data();
+        ValueType* distance_row = distances.data() + i * (i - 1) / 2;
+
+        index_t_ripser j = 0;
+        if (recurrence && i - segment_begin >= lag) {
+          const value_t_ripser* previous = squared_rows[(i - lag) % (lag + 1)].data();
+          const value_t_ripser first_i = x[i - lag], last_i = x[i + last];
+          for (; j < lag; ++j) {
+            squared[j] = points.squared_distance(i, j);
+            distance_row[j] = std::sqrt(squared[j]);
+          }
+          for (; j < i; ++j) {
+            value_t_ripser removed = first_i - x[j - lag], added = last_i - x[j + last];
+            value_t_ripser s = previous[j - lag] - removed * removed + added * added;
+            squared[j] = s > 0 ? s : 0;
+            distance_row[j] = std::sqrt(squared[j]);
+          }
+        }
+        for (; j < i; ++j) {
+          squared[j] = points.squared_distance(i, j);
+          distance_row[j] = std::sqrt(squared[j]);
+        }
+      }
+    }
+  });
+
+  return compressed_lower_distance_matrix<ValueType>(std::move(distances));
+}
+
+// reduces dimensions 1 to dim_max, starting from the edges and the columns of the edges that are not in a pair yet;
+// Entry is z2_entry_t when field is Z/2 and entry_t otherwise
+template <typename Entry, typename DistanceMatrix, typename ValueType = typename DistanceMatrix::value_type>
+  void compute_higher_pairs(std::vector<diameter_index_t<ValueType>>& simplices,
+                            std::vector<diameter_index_t<ValueType>>& columns_to_reduce, const DistanceMatrix& dist,
+                            index_t_ripser dim_max, index_t_ripser n, ValueType threshold, const prime_field& field,
+                            const binomial_coeff_table& binomial_coeff,
+                            persistence_pairs& pers_hom, int num_threads) {
+    const coefficient_t_ripser modulus = field.modulus();
+
+    for (index_t_ripser dim = 1; dim <= dim_max; ++dim) {
+      hash_map<index_t_ripser, index_t_ripser> pivot_column_index;
+
+      {
+        profile_phase phase("reduce", dim, modulus);
+        pivot_column_index.reserve(columns_to_reduce.size());
+
+        if (num_threads > 1)
+          compute_pairs_parallel<Entry>(columns_to_reduce, pivot_column_index, dim, n, threshold, modulus, field,
+                                        dist, binomial_coeff, pers_hom, num_threads);
+        else
+          compute_pairs<Entry>(columns_to_reduce, pivot_column_index, dim, n, threshold, modulus, field, dist,
+                               binomial_coeff, pers_hom);
+      }
+
+      if (dim < dim_max) {
+        profile_phase phase("assemble", dim + 1, modulus);
+        assemble_columns_to_reduce(simplices, columns_to_reduce, pivot_column_index, dist, dim, dim_max, n,
+                                   threshold, modulus, binomial_coeff, num_threads);
+        phase.hold(vector_bytes(simplices) + vector_bytes(columns_to_reduce) + pivot_column_index.bytes());
+      }
+    }
+  }
+
+// strong edge collapse of the flag filtration (Boissonnat and Pritam, Edge collapse and persistence of flag
+// complexes, SoCG 2020); an edge uv is dominated by a vertex w if w is adjacent to every common neighbor of u and v,
+// and removing a dominated edge leaves the flag complex homotopy equivalent; edges are inserted in filtration order,
+// and an edge that is not dominated when inserted becomes critical and stays, after which the earlier edges around
+// it are checked again from the latest down, with the non-critical ones above each one removed, and those no longer
+// dominated become critical at the current filtration value; the critical edges span a flag filtration with the same
+// persistence in every dimension, usually with far fewer edges
+template <typename ValueType> class edge_collapser {
+  struct filtered_edge {
+    ValueType diameter;
+    index_t_ripser u, v;
+  };
+
+  std::vector<filtered_edge> edges;
+  // (vertex, edge) for every edge inserted so far
+  std::vector<std::vector<std::pair<index_t_ripser, index_t_ripser>>> neighbors;
+  std::vector<char> critical;
+  // common neighbors of the edge last looked at, with the edges joining them to its ends
+  std::vector<index_t_ripser> common, common_edges;
+  std::vector<index_t_ripser> mark, mark_edge;
+  index_t_ripser stamp;
+  std::vector<std::vector<diameter_index_t<ValueType>>> kept;
+
+  // while edge current is checked, the non-critical edges inserted after it are removed
+  bool is_present(index_t_ripser e, index_t_ripser current) const { return e <= current || critical[e]; }
+
+  void find_common_neighbors(index_t_ripser e) {
+    const index_t_ripser u = edges[e].u, v = edges[e].v;
+    common.clear();
+    common_edges.clear();
+    ++stamp;
+    for (auto& neighbor : neighbors[u])
+      if (is_present(neighbor.second, e)) {
+        mark[neighbor.first] = stamp;
+        mark_edge[neighbor.first] = neighbor.second;
+      }
+    for (auto& neighbor : neighbors[v])
+      if (is_present(neighbor.second, e) && mark[neighbor.first] == stamp) {
+        common.push_back(neighbor.first);
+        common_edges.push_back(mark_edge[neighbor.first]);
+        common_edges.push_back(neighbor.second);
+      }
+  }
+
+  // whether some common neighbor w of the ends of edge e is adjacent to all the others; leaves the common neighbors
+  // of e in common and common_edges
+  bool is_dominated(index_t_ripser e) {
+    find_common_neighbors(e);
+    for (index_t_ripser w : common) {
+      ++stamp;
+      for (auto& neighbor : neighbors[w])
+        if (is_present(neighbor.second, e)) mark[neighbor.first] = stamp;
+      bool dominates = true;
+      for (index_t_ripser x : common)
+        if (x != w && mark[x] != stamp) {
+          dominates = false;
+          break;
+        }
+      if (dominates) return true;
+    }
+    return false;
+  }
+
+  void keep(index_t_ripser e, ValueType diameter) {
+    critical[e] = true;
+    kept[edges[e].u].push_back(std::make_pair(diameter, edges[e].v));
+    kept[edges[e].v].push_back(std::make_pair(diameter, edges[e].u));
+  }
+
+  // edge e just became critical: the earlier edges in a triangle with it may have lost their domination
+  void update_earlier_edges(index_t_ripser e) {
+    const ValueType diameter = edges[e].diameter;
+    std::priority_queue<index_t_ripser> pending(common_edges.begin(), common_edges.end());
+    while (!pending.empty()) {
+      index_t_ripser f = pending.top();
+      while (!pending.empty() && pending.top() == f) pending.pop();
+      if (critical[f] || is_dominated(f)) continue;
+      keep(f, diameter);
+      for (index_t_ripser g : common_edges)
+        if (g < f) pending.push(g);
+    }
+  }
+
+  public:
+    edge_collapser(index_t_ripser n) : neighbors(n), mark(n, 0), mark_edge(n), stamp(0), kept(n) {}
+
+  // edges are given by their index as simplices, as get_edges returns them
+  void collapse(std::vector<diameter_index_t<ValueType>>& filtration, const binomial_coeff_table& binomial_coeff) {
+    std::sort(filtration.rbegin(), filtration.rend(), greater_diameter_or_smaller_index<diameter_index_t<ValueType>>());
+    edges.reserve(filtration.size());
+    critical.reserve(filtration.size());
+    index_t_ripser vertices[2];
+    for (auto& edge : filtration) {
+      get_simplex_vertices(get_index(edge), 1, neighbors.size(), binomial_coeff, vertices);
+      filtered_edge inserted = {get_diameter(edge), vertices[0], vertices[1]};
+      const index_t_ripser e = edges.size();
+      edges.push_back(inserted);
+      critical.push_back(false);
+      neighbors[inserted.u].push_back(std::make_pair(inserted.v, e));
+      neighbors[inserted.v].push_back(std::make_pair(inserted.u, e));
+
+      if (!is_dominated(e)) {
+        keep(e, inserted.diameter);
+        update_earlier_edges(e);
+      }
+    }
+  }
+
+  sparse_distance_matrix<ValueType> collapsed_matrix() {
+    for (auto& neighbor_list : kept)
+      std::sort(neighbor_list.begin(), neighbor_list.end(), smaller_index<diameter_index_t<ValueType>>());
+    return sparse_distance_matrix<ValueType>(std::move(kept));
   }
+};
+
+// the collapsed flag filtration of the edges up to threshold, as a sparse matrix for ripser_compute
+template <typename DistanceMatrix>
+  sparse_distance_matrix<typename DistanceMatrix::value_type>
+  collapse_edges(const DistanceMatrix& dist, typename DistanceMatrix::value_type threshold) {
+  typedef typename DistanceMatrix::value_type value_t;
+  const index_t_ripser n = dist.size();
+  binomial_coeff_table binomial_coeff(n, 2);
+  edge_collapser<value_t> collapser(n);
+  {
+    std::vector<diameter_index_t<value_t>> edges = get_edges(dist, threshold, binomial_coeff);
+    collapser.collapse(edges, binomial_coeff);
+  }
+  return collapser.collapsed_matrix();
 }
 
-// Given distances and parameters, computes barcodes
+// number of points a thread takes at a time when updating their distances to a greedy permutation or a set of landmarks
+static const size_t witness_chunk_size = 4096;
+// number of points a thread takes at a time when collecting their neighbors in the sparse Rips filtration
+static const size_t neighbor_chunk_size = 64;
+// number of witnesses after which the largest edge so far, below which a witness has to see a pair, is updated
+static const index_t_ripser witness_bound_interval = 256;
+
+// the first num_points points of a greedy permutation (maxmin or farthest point sampling) starting from point 0, each
+// with its insertion radius, its distance to the points before it (infinity for point 0); returns the covering
+// radius, the largest distance from any point to the selected ones; ties go to the lowest index, so the selection does
+// not depend on the number of threads
+template <typename DistanceMatrix>
+  value_t_ripser greedy_permutation(const DistanceMatrix& dist, index_t_ripser num_points,
+                                    std::vector<index_t_ripser>& points, std::vector<value_t_ripser>& insertion_radii,
+                                    int num_threads = 1) {
+  const index_t_ripser n = dist.size();
+  // distance of each point to the points selected so far
+  std::vector<value_t_ripser> nearest(n, std::numeric_limits<value_t_ripser>::infinity());
+  std::vector<char> selected(n, false);
+  // farthest point from the selection, as found by each thread
+  std::vector<std::pair<value_t_ripser, index_t_ripser>> farthest(num_threads);
+  index_t_ripser next = 0;
+  value_t_ripser radius = std::numeric_limits<value_t_ripser>::infinity();
+
+  for (index_t_ripser k = 0; k < std::min(num_points, n); ++k) {
+    const index_t_ripser v = next;
+    points.push_back(v);
+    insertion_radii.push_back(radius);
+    selected[v] = true;
+
+    std::fill(farthest.begin(), farthest.end(), std::make_pair(value_t_ripser(-1), index_t_ripser(-1)));
+    parallel_for_chunks(n, witness_chunk_size, num_threads, [&](size_t begin, size_t end, int thread) {
+      for (index_t_ripser u = begin; u < index_t_ripser(end); ++u) {
+        if (selected[u]) continue;
+        nearest[u] = std::min<value_t_ripser>(nearest[u], dist(u, v));
+        // chunks reach a thread in any order, so ties go to the lowest index here as well
+        if (nearest[u] > farthest[thread].first || (nearest[u] == farthest[thread].first && u < farthest[thread].second))
+          farthest[thread] = std::make_pair(nearest[u], u);
+      }
+    });
+
+    radius = -1;
+    for (auto& candidate : farthest)
+      if (candidate.first > radius || (candidate.first == radius && candidate.second < next)) {
+        radius = candidate.first;
+        next = candidate.second;
+      }
+  }
+  // every point is selected
+  return std::max<value_t_ripser>(radius, 0);
+}
+
+// Sheehy's sparse Rips filtration, in the formulation of Cavanna, Jahanseir and Sheehy (A geometric perspective on
+// sparse filtrations, CCCG 2015): a point with insertion radius lambda keeps its ball until scale
+// lambda (1 + epsilon) / epsilon, shrinks it relative to the other balls until lambda (1 + epsilon)^2 / epsilon, and adds
+// no edge after that; each edge enters at the first scale at which the two balls meet, which stretches its length
+// past lambda (1 + epsilon) / epsilon; the result has O(n) edges for points in a doubling space and is a
+// (1 + epsilon)-approximation of the Rips filtration, with persistence diagrams to match
+template <typename ValueType, typename DistanceMatrix>
+  sparse_distance_matrix<ValueType> sparse_rips_approximation(const DistanceMatrix& dist, value_t_ripser epsilon,
+                                                              ValueType threshold, int num_threads = 1) {
+  const index_t_ripser n = dist.size();
+  std::vector<index_t_ripser> permutation;
+  std::vector<value_t_ripser> radii, insertion_radius(n);
+  greedy_permutation(dist, n, permutation, radii, num_threads);
+  for (index_t_ripser k = 0; k < n; ++k) insertion_radius[permutation[k]] = radii[k];
+  const value_t_ripser shrink_start = (1 + epsilon) / epsilon, removal = (1 + epsilon) * (1 + epsilon) / epsilon;
+
+  // each thread collects the smaller neighbors of its rows; the larger ones are added afterwards
+  std::vector<std::vector<diameter_index_t<ValueType>>> neighbors(n);
+  parallel_for_chunks(n, neighbor_chunk_size, num_threads, [&](size_t begin, size_t end, int) {
+    for (index_t_ripser i = begin; i < index_t_ripser(end); ++i)
+      for (index_t_ripser j = 0; j < i; ++j) {
+        const value_t_ripser smaller = std::min(insertion_radius[i], insertion_radius[j]),
+          larger = std::max(insertion_radius[i], insertion_radius[j]);
+        // the edge must appear before the point with the smaller radius stops adding edges and before the ball of
+        // the other one starts to shrink
+        const value_t_ripser bound = std::min((shrink_start + removal) * smaller, shrink_start * (smaller + larger));
+        const value_t_ripser d = dist(i, j);
+        if (!(d <= bound)) continue;
+        const value_t_ripser diameter = d <= 2 * shrink_start * smaller ? d : 2 * (d - shrink_start * smaller);
+        if (diameter > threshold) continue;
+        neighbors[i].push_back(std::make_pair(ValueType(diameter), j));
+      }
+  });
+  add_larger_neighbors(neighbors);
+  return sparse_distance_matrix<ValueType>(std::move(neighbors));
+}
+
+// lazy witness filtration of de Silva and Carlsson (Topological estimation using witness complexes, SPBG 2004) on the
+// landmarks: with m(w) the distance from a witness w to its nu-th nearest landmark (0 for nu = 0), landmarks a and b
+// are joined at min over all points w of max(d(w, a), d(w, b)) - m(w), and the filtration is the flag complex of these
+// edges; each thread keeps its own minima over its witnesses, which are combined at the end, and skips the pairs a
+// witness sees no earlier than every edge already has
+template <typename ValueType, typename DistanceMatrix>
+  compressed_lower_distance_matrix<ValueType>
+  lazy_witness_matrix(const DistanceMatrix& dist, const std::vector<index_t_ripser>& landmarks, int nu,
+                      int num_threads) {
+  const index_t_ripser n = dist.size(), num_landmarks = landmarks.size();
+  // a single landmark has no edge for the thread minima to bound
+  if (num_landmarks < 2) throw std::invalid_argument("The witness complex needs at least two landmarks.");
+  const size_t num_edges = num_landmarks * (num_landmarks - 1) / 2;
+  num_threads = std::max<size_t>(1, std::min<size_t>(num_threads, (n + witness_chunk_size - 1) / witness_chunk_size));
+  std::vector<std::vector<value_t_ripser>> thread_edges(
+    num_threads, std::vector<value_t_ripser>(num_edges, std::numeric_limits<value_t_ripser>::infinity()));
+
+  parallel_for_chunks(n, witness_chunk_size, num_threads, [&](size_t begin, size_t end, int thread) {
+    std::vector<value_t_ripser>& edges = thread_edges[thread];
+    value_t_ripser max_edge = std::numeric_limits<value_t_ripser>::infinity();
+    // distances from the witness to the landmarks, nearest first
+    std::vector<std::pair<value_t_ripser, index_t_ripser>> nearest(num_landmarks);
+    for (index_t_ripser w = begin; w < index_t_ripser(end); ++w) {
+      if ((w - begin) % witness_bound_interval == 0) max_edge = *std::max_element(edges.begin(), edges.end());
+      for (index_t_ripser l = 0; l < num_landmarks; ++l) nearest[l] = std::make_pair(dist(w, landmarks[l]), l);
+      std::sort(nearest.begin(), nearest.end());
+      const value_t_ripser offset = nu == 0 ? 0 : nearest[nu - 1].first;
+      // the farther landmark of each pair decides when this witness sees it
+      for (index_t_ripser j = 1; j < num_landmarks; ++j) {
+        const value_t_ripser diameter = std::max<value_t_ripser>(nearest[j].first - offset, 0);
+        if (diameter >= max_edge) break;
+        const index_t_ripser b = nearest[j].second;
+        for (index_t_ripser i = 0; i < j; ++i) {
+          const index_t_ripser a = nearest[i].second;
+          value_t_ripser& edge = a > b ? edges[a * (a - 1) / 2 + b] : edges[b * (b - 1) / 2 + a];
+          if (diameter < edge) edge = diameter;
+        }
+      }
+    }
+  });
+
+  std::vector<ValueType> distances(num_edges);
+  for (size_t e = 0; e < num_edges; ++e) {
+    value_t_ripser diameter = thread_edges[0][e];
+    for (int t = 1; t < num_threads; ++t) diameter = std::min(diameter, thread_edges[t][e]);
+    distances[e] = diameter;
+  }
+  phase_profile::hold(vector_bytes(distances) + num_threads * vector_bytes(thread_edges[0]));
+  return compressed_lower_distance_matrix<ValueType>(std::move(distances));
+}
+
+// Given distances and parameters, computes barcodes, one set of pairs for each prime in primes; dimension 0 and the
+// edges that start dimension 1 do not depend on the prime, so they are computed once for all of them; the primes are
+// checked by check_primes beforehand, and nothing here calls into R, so it may run on any thread
 template < typename DistanceMatrix >
-  NumericVector ripser_compute(const DistanceMatrix& dist, int dim, float thresh, int p){
+  std::vector<persistence_pairs> ripser_compute(const DistanceMatrix& dist, int dim, float thresh, const std::vector<int>& primes,
+                      int num_threads){
 
     //MY VARS
     int currDim = 0;
-    std::vector<std::vector<value_t_ripser>> pers_hom;
+    typedef typename DistanceMatrix::value_type value_t;
+    persistence_pairs pers_hom_0;
 
     index_t_ripser dim_max = dim;
-    value_t_ripser threshold = std::numeric_limits<value_t_ripser>::max();
+    value_t threshold = std::numeric_limits<value_t>::max();
     if (thresh > 0)
       threshold = thresh;
 
-    // MJP - Check coefficient p is prime (and positive).
-    if (p < 0 || !is_prime(p)){ Rcpp::stop("Non-prime supplied to p."); }
-    const coefficient_t_ripser modulus = p;
-
     index_t_ripser n = dist.size();
     dim_max = std::min(dim_max, n - 2);
-    binomial_coeff_table binomial_coeff(n, dim_max + 2);
-    std::vector<coefficient_t_ripser> multiplicative_inverse(multiplicative_inverse_vector(modulus));
-    std::vector<diameter_index_t> columns_to_reduce;
+    binomial_coeff_table binomial_coeff(n, dim_max + 2, max_simplex_index_for(primes));
+    std::vector<diameter_index_t<value_t>> edges, edge_columns;
 
     {
-      union_find dset(n);
-      std::vector<diameter_index_t> edges;
-      rips_filtration_comparator<decltype(dist)> comp(dist, 1, binomial_coeff);
-      for (index_t_ripser index = binomial_coeff(n, 2); index-- > 0;) {
-        value_t_ripser diameter = comp.diameter(index);
-        if (diameter <= threshold) edges.push_back(std::make_pair(diameter, index));
+      {
+        profile_phase phase("edges");
+        edges = get_edges(dist, threshold, binomial_coeff);
+        std::sort(edges.rbegin(), edges.rend(), greater_diameter_or_smaller_index<diameter_index_t<value_t>>());
+        phase.hold(vector_bytes(edges));
       }
-      std::sort(edges.rbegin(), edges.rend(), greater_diameter_or_smaller_index<diameter_index_t>());
+
+      profile_phase phase("union_find", 0);
+      union_find dset(n);
+      // every merge of two components is a pair, so there are fewer than n of them
+      pers_hom_0.reserve(n);
 
       //PRINT VALUE
       currDim = 0;
@@ -672,69 +2181,749 @@ template < typename DistanceMatrix >
 
         if (u != v) {
           //PRINT VALUE
-          if (get_diameter(e) > 0) {
-            std::vector<value_t_ripser> curr;
-            curr.push_back(currDim);
-            curr.push_back(0);
-            curr.push_back(get_diameter(e));
-            pers_hom.push_back(curr);
-          }
+          if (get_diameter(e) > 0) pers_hom_0.push_back(currDim, 0, get_diameter(e));
           dset.link(u, v);
-        } else {
-          columns_to_reduce.push_back(e);
+        } else if (dim_max > 0) {
+          edge_columns.push_back(e);
         }
       }
 
-      std::reverse(columns_to_reduce.begin(), columns_to_reduce.end());
+      // edges in a zero-persistence apparent pair with a triangle need no column; apparent pairs only depend
+      // on the diameters, so the same edges are dropped for every prime and Z/2 entries do
+      std::vector<char> is_apparent(edge_columns.size());
+      parallel_for_chunks(edge_columns.size(), assembly_chunk_size, num_threads,
+                          [&](size_t begin, size_t end, int) {
+                            for (size_t k = begin; k < end; ++k)
+                              is_apparent[k] = get_index(get_zero_apparent_cofacet(
+                                diameter_entry_t<value_t, z2_entry_t>(edge_columns[k], 1), 1, n, 2, dist,
+                                binomial_coeff)) != -1;
+                          });
+      size_t num_columns = 0;
+      for (size_t k = 0; k < edge_columns.size(); ++k)
+        if (!is_apparent[k]) edge_columns[num_columns++] = edge_columns[k];
+      edge_columns.resize(num_columns);
+
+      std::reverse(edge_columns.begin(), edge_columns.end());
+      phase.hold(dset.bytes() + pers_hom_0.bytes() + vector_bytes(edges) + vector_bytes(edge_columns) +
+                 vector_bytes(is_apparent));
+
+      // a sparse matrix assembles the next dimension from the cofaces of these edges, while a dense one enumerates
+      // it from the vertices and never reads them
+      if (dim_max < 2 || !std::is_same<DistanceMatrix, sparse_distance_matrix<value_t>>::value)
+        std::vector<diameter_index_t<value_t>>().swap(edges);
     }
 
-    for (index_t_ripser dim = 1; dim <= dim_max; ++dim) {
+    std::vector<persistence_pairs> ans(primes.size());
+    for (size_t k = 0; k < primes.size(); ++k) {
+      const coefficient_t_ripser modulus = primes[k];
+      const prime_field field(modulus);
+      persistence_pairs pers_hom(pers_hom_0);
+      std::vector<diameter_index_t<value_t>> simplices, columns_to_reduce;
+
+      // the last prime takes the shared vectors instead of copying them (the edges are empty on a dense matrix)
+      if (k + 1 == primes.size()) {
+        simplices.swap(edges);
+        columns_to_reduce.swap(edge_columns);
+      } else {
+        simplices = edges;
+        columns_to_reduce = edge_columns;
+      }
 
-      rips_filtration_comparator<decltype(dist)> comp(dist, dim + 1, binomial_coeff);
-      rips_filtration_comparator<decltype(dist)> comp_prev(dist, dim, binomial_coeff);
+      // Z/2 has its own instantiation of the reduction, whose entries carry no coefficients
+      if (modulus == 2)
+        compute_higher_pairs<z2_entry_t>(simplices, columns_to_reduce, dist, dim_max, n, threshold, field,
+                                         binomial_coeff, pers_hom, num_threads);
+      else
+        compute_higher_pairs<entry_t>(simplices, columns_to_reduce, dist, dim_max, n, threshold, field,
+                                      binomial_coeff, pers_hom, num_threads);
 
-      hash_map<index_t_ripser, index_t_ripser> pivot_column_index;
-      pivot_column_index.reserve(columns_to_reduce.size());
+      ans[k] = std::move(pers_hom);
+    }
+    return(ans);
+  }
 
-      compute_pairs(columns_to_reduce, pivot_column_index, dim, n, threshold, modulus, multiplicative_inverse, dist,
-                    comp, comp_prev, binomial_coeff, pers_hom);
 
-      if (dim < dim_max) {
-        assemble_columns_to_reduce(columns_to_reduce, pivot_column_index, comp, dim, n, threshold, binomial_coeff);
+// single precision needs its own (half-size) copy of the distances of a dist object
+template <typename ValueType>
+  compressed_upper_distance_matrix<ValueType> read_dist(const double* distances, size_t num_distances) {
+  return compressed_upper_distance_matrix<ValueType>(std::vector<ValueType>(distances, distances + num_distances));
+}
+
+// R stores a dist object column by column below the diagonal, i.e. the upper triangle row by row,
+// so the view reads it in place
+template <>
+  compressed_upper_distance_matrix<value_t_ripser> read_dist<value_t_ripser>(const double* distances,
+                                                                             size_t num_distances) {
+  return compressed_upper_distance_matrix<value_t_ripser>(distances, num_distances);
+}
+
+// MJP - Check coefficient p is prime (and positive).
+void check_primes(const std::vector<int>& primes) {
+  if (primes.empty()) Rcpp::stop("No prime supplied to p.");
+  for (int p : primes) {
+    if (p < 0 || !is_prime(p)){ Rcpp::stop("Non-prime supplied to p."); }
+    // coefficients are packed into the top bits of each entry
+    if (p >= (1 << num_coefficient_bits)) Rcpp::stop("p must be less than 256.");
+  }
+}
+
+// one dimension/birth/death data frame for each prime
+List barcodes_to_list(const std::vector<persistence_pairs>& barcodes) {
+  List ans(barcodes.size());
+  for (size_t k = 0; k < barcodes.size(); ++k) ans[k] = barcodes[k].to_data_frame();
+  return ans;
+}
+
+// the distances (or points) that build returns, built as the named phase of the profile of the calling thread
+template <typename Build> auto profiled(const char* name, Build build) -> decltype(build()) {
+  profile_phase phase(name);
+  decltype(build()) result = build();
+  phase.hold(result.bytes());
+  return result;
+}
+
+template <typename ValueType>
+  std::vector<persistence_pairs> ripser_sparse(const sparse_distance_matrix<ValueType>& dist, int dim, float thresh,
+                                               const std::vector<int>& p, int num_threads, bool collapse) {
+  if (collapse)
+    return ripser_compute(
+      profiled("collapse", [&] { return collapse_edges(dist, std::numeric_limits<ValueType>::max()); }), dim, thresh,
+      p, num_threads);
+  return ripser_compute(dist, dim, thresh, p, num_threads);
+}
+
+template <compressed_matrix_layout Layout, typename ValueType>
+  std::vector<persistence_pairs> ripser_dist(const compressed_distance_matrix<Layout, ValueType>& dist, int dim,
+                                             float thresh, const std::vector<int>& p, int num_threads, bool collapse,
+                                             double epsilon) {
+  const ValueType threshold = thresh > 0 ? ValueType(thresh) : std::numeric_limits<ValueType>::max();
+
+  if (epsilon > 0)
+    return ripser_sparse(
+      profiled("distances", [&] { return sparse_rips_approximation(dist, epsilon, threshold, num_threads); }), dim,
+      thresh, p, num_threads, collapse);
+
+  if (collapse)
+    return ripser_compute(profiled("collapse", [&] { return collapse_edges(dist, threshold); }), dim, thresh, p,
+                          num_threads);
+
+  // a positive threshold switches to the sparse engine
+  if (thresh > 0)
+    return ripser_compute(
+      profiled("distances", [&] { return sparse_distance_matrix<ValueType>(dist, thresh, num_threads); }), dim,
+      thresh, p, num_threads);
+
+  return ripser_compute(dist, dim, thresh, p, num_threads);
+}
+
+// PointCloud is a point_cloud_distance_matrix or a delay_embedding
+template <typename ValueType, typename PointCloud>
+  std::vector<persistence_pairs> ripser_point_cloud(const PointCloud& points, int dim, float thresh,
+                                                    const std::vector<int>& p, int num_threads, bool collapse,
+                                                    double epsilon) {
+  const ValueType threshold = thresh > 0 ? ValueType(thresh) : std::numeric_limits<ValueType>::max();
+
+  // point cloud distances are computed on the fly, so the full matrix is never stored
+  if (epsilon > 0)
+    return ripser_sparse(
+      profiled("distances", [&] { return sparse_rips_approximation(points, epsilon, threshold, num_threads); }), dim,
+      thresh, p, num_threads, collapse);
+
+  // a positive threshold switches to the sparse engine, which never stores the full matrix
+  if (thresh > 0)
+    return ripser_sparse(
+      profiled("distances", [&] { return sparse_distance_matrix<ValueType>(points, threshold, num_threads); }), dim,
+      thresh, p, num_threads, collapse);
+
+  compressed_lower_distance_matrix<ValueType> dist =
+    profiled("distances", [&] { return read_point_cloud<ValueType>(points, num_threads); });
+
+  if (collapse)
+    return ripser_compute(
+      profiled("collapse", [&] { return collapse_edges(dist, std::numeric_limits<ValueType>::max()); }), dim, thresh,
+      p, num_threads);
+
+  // Return barcodes
+  return ripser_compute(dist, dim, thresh, p, num_threads);
+}
+
+template <typename ValueType, point_cloud_metric Metric>
+  std::vector<persistence_pairs> ripser_points(const NumericMatrix& input_points, int dim, float thresh,
+                                               const std::vector<int>& p, int format, int num_threads, bool collapse,
+                                               double epsilon) {
+  //get distance matrix based on input format
+  if (format == 0)
+    return ripser_point_cloud<ValueType>(profiled("input", [&] {
+                                           return point_cloud_distance_matrix<Metric>(getPoints(input_points),
+                                                                                      input_points.ncol());
+                                         }),
+                                         dim, thresh, p, num_threads, collapse, epsilon);
+  return ripser_dist(profiled("input", [&] { return getLowerDistMatrix<ValueType>(input_points); }), dim, thresh, p,
+                     num_threads, collapse, epsilon);
+}
+
+template <typename ValueType>
+  std::vector<persistence_pairs> ripser_points(const NumericMatrix& input_points, int dim, float thresh,
+                                               const std::vector<int>& p, int format, int num_threads, bool collapse,
+                                               double epsilon, int metric) {
+  switch (metric) {
+    case MANHATTAN:
+      return ripser_points<ValueType, MANHATTAN>(input_points, dim, thresh, p, format, num_threads, collapse, epsilon);
+    case MAXIMUM:
+      return ripser_points<ValueType, MAXIMUM>(input_points, dim, thresh, p, format, num_threads, collapse, epsilon);
+    case COSINE:
+      return ripser_points<ValueType, COSINE>(input_points, dim, thresh, p, format, num_threads, collapse, epsilon);
+    case CORRELATION:
+      return ripser_points<ValueType, CORRELATION>(input_points, dim, thresh, p, format, num_threads, collapse,
+                                                   epsilon);
+    default:
+      return ripser_points<ValueType, EUCLIDEAN>(input_points, dim, thresh, p, format, num_threads, collapse, epsilon);
+  }
+}
+
+// the landmarks are returned as rows of input_points, counting from 0
+template <typename ValueType, point_cloud_metric Metric>
+  std::vector<persistence_pairs> ripser_witness(const NumericMatrix& input_points, int dim, float thresh,
+                                                const std::vector<int>& p, int num_threads,
+                                                index_t_ripser num_landmarks, int nu, bool collapse,
+                                                std::vector<index_t_ripser>& landmarks,
+                                                value_t_ripser& covering_radius) {
+  // distances are computed on the fly, so neither the points nor the witnesses need a distance matrix
+  const point_cloud_distance_matrix<Metric> point_dist = profiled("input", [&] {
+    return point_cloud_distance_matrix<Metric>(getPoints(input_points), input_points.ncol());
+  });
+
+  {
+    profile_phase phase("landmarks");
+    std::vector<value_t_ripser> insertion_radii;
+    covering_radius = greedy_permutation(point_dist, num_landmarks, landmarks, insertion_radii, num_threads);
+    phase.hold(vector_bytes(landmarks) + vector_bytes(insertion_radii));
+  }
+
+  compressed_lower_distance_matrix<ValueType> dist =
+    profiled("distances", [&] { return lazy_witness_matrix<ValueType>(point_dist, landmarks, nu, num_threads); });
+
+  if (thresh > 0)
+    return ripser_sparse(
+      profiled("distances", [&] { return sparse_distance_matrix<ValueType>(dist, thresh, num_threads); }), dim,
+      thresh, p, num_threads, collapse);
+  if (collapse)
+    return ripser_compute(
+      profiled("collapse", [&] { return collapse_edges(dist, std::numeric_limits<ValueType>::max()); }), dim, thresh,
+      p, num_threads);
+  return ripser_compute(dist, dim, thresh, p, num_threads);
+}
+
+template <typename ValueType>
+  std::vector<persistence_pairs> ripser_witness(const NumericMatrix& input_points, int dim, float thresh,
+                                                const std::vector<int>& p, int num_threads,
+                                                index_t_ripser num_landmarks, int nu, bool collapse, int metric,
+                                                std::vector<index_t_ripser>& landmarks,
+                                                value_t_ripser& covering_radius) {
+  switch (metric) {
+    case MANHATTAN:
+      return ripser_witness<ValueType, MANHATTAN>(input_points, dim, thresh, p, num_threads, num_landmarks, nu,
+                                                  collapse, landmarks, covering_radius);
+    case MAXIMUM:
+      return ripser_witness<ValueType, MAXIMUM>(input_points, dim, thresh, p, num_threads, num_landmarks, nu,
+                                                collapse, landmarks, covering_radius);
+    case COSINE:
+      return ripser_witness<ValueType, COSINE>(input_points, dim, thresh, p, num_threads, num_landmarks, nu,
+                                               collapse, landmarks, covering_radius);
+    case CORRELATION:
+      return ripser_witness<ValueType, CORRELATION>(input_points, dim, thresh, p, num_threads, num_landmarks, nu,
+                                                    collapse, landmarks, covering_radius);
+    default:
+      return ripser_witness<ValueType, EUCLIDEAN>(input_points, dim, thresh, p, num_threads, num_landmarks, nu,
+                                                  collapse, landmarks, covering_radius);
+  }
+}
+
+// vertices sampled, random subsets of their neighbors tried per dimension, and simplices found among them that are
+// checked for a zero-persistence apparent pair, to estimate the number of simplices and of columns; the generator has a
+// fixed seed, so the same call always gives the same estimate
+static const index_t_ripser estimate_sample_size = 64;
+static const index_t_ripser estimate_subset_trials = 4096;
+static const index_t_ripser estimate_pair_checks = 32;
+static const uint64_t estimate_seed = 5489;
+
+// rough costs, in seconds, of one coordinate read while computing a distance, one comparison while sorting the edges,
+// and one coface of a column enumerated while reducing it with a dense or a sparse distance matrix
+static const double estimate_coordinate_cost = 1e-9;
+static const double estimate_comparison_cost = 5e-9;
+static const double estimate_dense_coface_cost = 1e-9;
+static const double estimate_sparse_coface_cost = 1e-8;
+
+// binomial coefficient in floating point, which cannot overflow for the sizes a calculation is estimated at
+inline double binomial_estimate(double n, index_t_ripser k) {
+  if (k < 0 || n < k) return 0;
+  double b = 1;
+  for (index_t_ripser j = 1; j <= k; ++j) b *= (n - k + j) / j;
+  return b;
+}
+
+template <typename DistanceMatrix>
+  bool is_clique(const DistanceMatrix& dist, const std::vector<index_t_ripser>& vertices, value_t_ripser threshold) {
+  for (size_t a = 1; a < vertices.size(); ++a)
+    for (size_t b = 0; b < a; ++b)
+      if (dist(vertices[a], vertices[b]) > threshold) return false;
+  return true;
+}
+
+// appends to cliques the k-subsets of neighbors[start..] whose vertices are within threshold of each other and of
+// those in clique
+template <typename DistanceMatrix>
+  void find_cliques(const DistanceMatrix& dist, const std::vector<index_t_ripser>& neighbors, size_t start,
+                    index_t_ripser k, value_t_ripser threshold, std::vector<index_t_ripser>& clique,
+                    std::vector<std::vector<index_t_ripser>>& cliques) {
+  if (k == 0) {
+    cliques.push_back(clique);
+    return;
+  }
+  for (size_t a = start; a + k <= neighbors.size(); ++a) {
+    if (std::any_of(clique.begin(), clique.end(),
+                    [&](index_t_ripser u) { return dist(u, neighbors[a]) > threshold; }))
+      continue;
+    clique.push_back(neighbors[a]);
+    find_cliques(dist, neighbors, a + 1, k - 1, threshold, clique, cliques);
+    clique.pop_back();
+  }
+}
+
+// estimated number of simplices of each dimension up to dim_max + 1 with diameter at most threshold, and of those of
+// each dimension up to dim_max that are in a zero-persistence apparent pair; each simplex of dimension k is a clique of
+// k neighbors of each of its vertices, so these cliques are counted around a sample of the vertices, exactly if the
+// neighbors have few enough k-subsets and from random k-subsets otherwise, a few of them are checked for an apparent
+// pair, and the counts are scaled up; without binomial_coeff (when the simplices cannot be indexed), no pair is checked
+template <typename DistanceMatrix>
+  void estimate_simplex_counts(const DistanceMatrix& dist, index_t_ripser dim_max, value_t_ripser threshold,
+                               const binomial_coeff_table* binomial_coeff, std::vector<double>& simplices,
+                               std::vector<double>& apparent) {
+  typedef typename DistanceMatrix::value_type value_t;
+  const index_t_ripser n = dist.size();
+  simplices.assign(dim_max + 2, 0);
+  apparent.assign(dim_max + 1, 0);
+
+  // the sampled vertices are the first num_samples of a partial shuffle
+  std::mt19937_64 generator(estimate_seed);
+  const index_t_ripser num_samples = std::min(n, estimate_sample_size);
+  std::vector<index_t_ripser> vertices(n);
+  std::iota(vertices.begin(), vertices.end(), index_t_ripser(0));
+  for (index_t_ripser s = 0; s < num_samples; ++s)
+    std::swap(vertices[s], vertices[std::uniform_int_distribution<index_t_ripser>(s, n - 1)(generator)]);
+
+  std::vector<index_t_ripser> neighbors, clique, simplex_vertices;
+  std::vector<std::vector<index_t_ripser>> cliques;
+  for (index_t_ripser s = 0; s < num_samples; ++s) {
+    const index_t_ripser v = vertices[s];
+    neighbors.clear();
+    for (index_t_ripser u = 0; u < n; ++u)
+      if (u != v && dist(u, v) <= threshold) neighbors.push_back(u);
+
+    simplices[0] += 1;
+    for (index_t_ripser k = 1; k <= dim_max + 1; ++k) {
+      const double num_subsets = binomial_estimate(neighbors.size(), k);
+      if (num_subsets == 0) break;
+
+      // the cliques found, and the number of cliques each of them stands for
+      cliques.clear();
+      double weight = 1;
+      if (num_subsets <= estimate_subset_trials) {
+        clique.clear();
+        find_cliques(dist, neighbors, 0, k, threshold, clique, cliques);
+      } else {
+        std::uniform_int_distribution<size_t> pick(0, neighbors.size() - 1);
+        for (index_t_ripser t = 0; t < estimate_subset_trials; ++t) {
+          clique.clear();
+          while (index_t_ripser(clique.size()) < k) {
+            const index_t_ripser u = neighbors[pick(generator)];
+            if (std::find(clique.begin(), clique.end(), u) == clique.end()) clique.push_back(u);
+          }
+          if (is_clique(dist, clique, threshold)) cliques.push_back(clique);
+        }
+        weight = num_subsets / estimate_subset_trials;
+      }
+      simplices[k] += weight * cliques.size();
+      if (k > dim_max || cliques.empty() || binomial_coeff == nullptr) continue;
+
+      // the simplices checked for an apparent pair are drawn from those found
+      const index_t_ripser num_checks = std::min<index_t_ripser>(cliques.size(), estimate_pair_checks);
+      index_t_ripser num_apparent = 0;
+      for (index_t_ripser c = 0; c < num_checks; ++c) {
+        simplex_vertices = cliques[std::uniform_int_distribution<size_t>(0, cliques.size() - 1)(generator)];
+        simplex_vertices.push_back(v);
+        std::sort(simplex_vertices.rbegin(), simplex_vertices.rend());
+        index_t_ripser index = 0;
+        value_t diameter = 0;
+        for (index_t_ripser a = 0; a <= k; ++a) {
+          index += (*binomial_coeff)(simplex_vertices[a], k + 1 - a);
+          for (index_t_ripser b = 0; b < a; ++b)
+            diameter = std::max<value_t>(diameter, dist(simplex_vertices[a], simplex_vertices[b]));
+        }
+        num_apparent += is_in_zero_apparent_pair(diameter_entry_t<value_t, z2_entry_t>(diameter, index, 1), k, n, 2,
+                                                 dist, *binomial_coeff, &simplex_vertices);
       }
+      apparent[k] += weight * cliques.size() * num_apparent / num_checks;
     }
+  }
 
-    NumericVector ans(pers_hom.size() * 3);
-    int ind = 0;
-    for (int i = 0; i < pers_hom.size(); i++){
-      for (int j = 0; j < 3; j++) {
-        ans[ind++] = pers_hom[i][j];
-      }
+  // each simplex of dimension k was counted once around each of its k + 1 vertices
+  for (index_t_ripser k = 0; k <= dim_max + 1; ++k) {
+    simplices[k] *= double(n) / (num_samples * (k + 1));
+    if (k <= dim_max) apparent[k] *= double(n) / (num_samples * (k + 1));
+  }
+}
+
+// bytes of a hash_map reserved for num_entries entries
+inline double hash_map_bytes(double num_entries) {
+  double capacity = 16;
+  while (capacity < 2 * num_entries) capacity *= 2;
+  return capacity * sizeof(std::pair<index_t_ripser, index_t_ripser>);
+}
+
+// bytes of a vector of num_entries simplices pushed back one at a time, whose capacity doubles as it grows
+inline double grown_vector_bytes(double num_entries) {
+  double capacity = 1;
+  while (capacity < num_entries) capacity *= 2;
+  return capacity * sizeof(diameter_index_t<value_t_ripser>);
+}
+
+// estimate of ripser_compute on dist, as a list of the estimated simplices and columns of each dimension up to dim_max,
+// the peak bytes and the seconds; input_bytes are held throughout (the points, or a single precision copy of a dist
+// object), and so are distance_bytes when the engine runs on a dense distance matrix (sparse is false), whose
+// computation reads distance_coordinates coordinates; the sizes follow the vectors and tables of the engine, which
+// holds one reduced column of at least one entry per column, so the estimate errs on the low side when the columns
+// fill in; when ripser_compute would refuse to index the simplices for primes, the plan says so in index_overflow
+// instead, and counts every simplex as a column
+template <typename DistanceMatrix>
+  List rips_estimate(const DistanceMatrix& dist, index_t_ripser dim_max, float thresh, const std::vector<int>& primes,
+                     int num_threads, double input_bytes, double distance_bytes, double distance_coordinates,
+                     bool sparse) {
+  const index_t_ripser n = dist.size();
+  const int num_primes = primes.size();
+  const value_t_ripser threshold = thresh > 0 ? thresh : std::numeric_limits<value_t_ripser>::max();
+  // the same table as ripser_compute builds, which only the apparent pairs need
+  std::unique_ptr<binomial_coeff_table> binomial_coeff;
+  try {
+    binomial_coeff.reset(new binomial_coeff_table(n, dim_max + 2, max_simplex_index_for(primes)));
+  } catch (const std::overflow_error&) {
+  }
+  std::vector<double> simplices, apparent;
+  estimate_simplex_counts(dist, dim_max, threshold, binomial_coeff.get(), simplices, apparent);
+
+  // the edges that merge two components need no column either
+  std::vector<double> columns(dim_max + 1, 0);
+  for (index_t_ripser dim = 1; dim <= dim_max; ++dim)
+    columns[dim] = std::max(0.0, simplices[dim] - apparent[dim] - (dim == 1 ? n - 1 : 0));
+
+  const double entry_bytes = sizeof(diameter_index_t<value_t_ripser>);
+  const double num_edges = simplices[1];
+
+  double base_bytes = input_bytes + (n + 1) * (dim_max + 3) * sizeof(index_t_ripser);
+  // a sparse matrix lists each edge under both of its vertices
+  base_bytes += sparse ? (2 * num_edges * entry_bytes + n * sizeof(std::vector<diameter_index_t<value_t_ripser>>))
+                       : distance_bytes;
+
+  // dimension 0 sorts the edges, which are only reserved up front without a threshold, and keeps those that close a
+  // cycle, flagging the apparent ones
+  double peak_bytes = base_bytes + (sparse ? grown_vector_bytes(num_edges) : num_edges * entry_bytes) +
+                      grown_vector_bytes(num_edges - n + 1) + num_edges + n * (sizeof(index_t_ripser) + 1);
+  // all but the last prime reduce copies of the edge columns, and of the edges on a sparse matrix
+  if (num_primes > 1) base_bytes += ((sparse && dim_max > 1 ? num_edges : 0) + columns[1]) * entry_bytes;
+  for (index_t_ripser dim = 1; dim <= dim_max; ++dim) {
+    const double next_columns = dim < dim_max ? columns[dim + 1] : 0;
+    // the columns, their pivots, their reduced columns with a bound each, and the next dimension's columns in
+    // per-thread buffers and then collected
+    double bytes = base_bytes + columns[dim] * (2 * entry_bytes + sizeof(size_t)) + hash_map_bytes(columns[dim]) +
+                   grown_vector_bytes(next_columns) + next_columns * entry_bytes;
+    // the sparse engine keeps the simplices the next dimension is assembled from; the dense one keeps none
+    if (sparse)
+      bytes += (dim < dim_max ? simplices[dim] * entry_bytes : 0) +
+               (dim + 1 < dim_max ? grown_vector_bytes(simplices[dim + 1]) : 0);
+    peak_bytes = std::max(peak_bytes, bytes);
+  }
+
+  // every simplex of dimension dim + 1 is a coface of dim + 2 simplices of dimension dim
+  double cofaces = 0;
+  for (index_t_ripser dim = 1; dim <= dim_max; ++dim) cofaces += (dim + 2) * simplices[dim + 1];
+  const double coface_cost = sparse ? estimate_sparse_coface_cost : estimate_dense_coface_cost;
+  const double seconds =
+    (distance_coordinates * estimate_coordinate_cost + num_primes * cofaces * coface_cost) / num_threads +
+    num_edges * std::log2(num_edges + 1) * estimate_comparison_cost;
+
+  std::vector<int> dimensions(dim_max + 1);
+  std::iota(dimensions.begin(), dimensions.end(), 0);
+  columns[0] = n;
+  return List::create(Named("simplices") =
+                        DataFrame::create(Named("dimension") = IntegerVector(dimensions.begin(), dimensions.end()),
+                                          Named("simplices") = NumericVector(simplices.begin(),
+                                                                             simplices.begin() + dim_max + 1),
+                                          Named("columns") = NumericVector(columns.begin(), columns.end())),
+                      Named("peak_bytes") = peak_bytes, Named("seconds") = seconds,
+                      Named("index_overflow") = !binomial_coeff);
+}
+
+// the distances between some of the points of a distance matrix, by which the estimate stands in for those of a
+// witness complex on them
+template <typename DistanceMatrix> class landmark_distance_matrix {
+  public:
+    typedef typename DistanceMatrix::value_type value_type;
+
+  const DistanceMatrix& dist;
+  const std::vector<index_t_ripser>& landmarks;
+
+  landmark_distance_matrix(const DistanceMatrix& _dist, const std::vector<index_t_ripser>& _landmarks)
+  : dist(_dist), landmarks(_landmarks) {}
+
+  value_type operator()(const index_t_ripser i, const index_t_ripser j) const {
+    return dist(landmarks[i], landmarks[j]);
+  }
+
+  size_t size() const { return landmarks.size(); }
+};
+
+template <point_cloud_metric Metric>
+  List ripser_points_estimate(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p,
+                              int num_threads, int precision, index_t_ripser num_landmarks) {
+  const point_cloud_distance_matrix<Metric> points(getPoints(input_points), input_points.ncol());
+  const double n = points.size(), coordinates = points.dim;
+  const double value_bytes = precision == 1 ? sizeof(float) : sizeof(value_t_ripser);
+  const double input_bytes = n * coordinates * sizeof(value_t_ripser);
+
+  if (num_landmarks > 0) {
+    // the landmarks are selected as ripser_cpp_witness does, which only takes the distance of each point to them
+    std::vector<index_t_ripser> landmarks;
+    std::vector<value_t_ripser> insertion_radii;
+    greedy_permutation(points, num_landmarks, landmarks, insertion_radii, num_threads);
+    // fewer landmarks than requested are selected when there are fewer points
+    const index_t_ripser num_selected = landmarks.size();
+    const double num_distances = num_selected * (num_selected - 1) / 2.0;
+    // and then every point is a witness to the landmarks once more
+    return rips_estimate(landmark_distance_matrix<point_cloud_distance_matrix<Metric>>(points, landmarks),
+                         std::min<index_t_ripser>(dim, num_selected - 2), thresh, p, num_threads,
+                         input_bytes + n * sizeof(value_t_ripser), num_distances * value_bytes,
+                         2 * n * num_selected * coordinates, thresh > 0);
+  }
+
+  const double num_distances = n * (n - 1) / 2;
+  return rips_estimate(points, std::min<index_t_ripser>(dim, index_t_ripser(n) - 2), thresh, p, num_threads,
+                       input_bytes, num_distances * value_bytes, num_distances * coordinates, thresh > 0);
+}
+
+// each dataset is reduced on a single thread, and num_threads datasets at a time; the R objects are only read here,
+// before any worker starts, so the workers see nothing but copies of the points and views of the dist objects
+template <typename ValueType>
+  List ripser_batch(const List& datasets, int dim, float thresh, const std::vector<int>& p, int num_threads,
+                    bool collapse, double epsilon) {
+  const size_t num_datasets = datasets.size();
+  std::vector<std::unique_ptr<euclidean_distance_matrix>> point_clouds(num_datasets);
+  // kept alive until the workers are done, in case a dist object had to be coerced to double
+  std::vector<NumericVector> dists(num_datasets);
+  for (size_t k = 0; k < num_datasets; ++k) {
+    RObject dataset = datasets[k];
+    if (dataset.inherits("dist")) {
+      dists[k] = NumericVector(dataset);
+    } else {
+      NumericMatrix input_points(dataset);
+      point_clouds[k].reset(new euclidean_distance_matrix(getPoints(input_points), input_points.ncol()));
     }
-    return(ans);
   }
 
+  std::vector<std::vector<persistence_pairs>> barcodes(num_datasets);
+  parallel_for_chunks(num_datasets, 1, num_threads, [&](size_t begin, size_t end, int) {
+    for (size_t k = begin; k < end; ++k) {
+      if (point_clouds[k])
+        barcodes[k] = ripser_point_cloud<ValueType>(*point_clouds[k], dim, thresh, p, 1, collapse, epsilon);
+      else
+        barcodes[k] = ripser_dist(read_dist<ValueType>(dists[k].begin(), dists[k].size()), dim, thresh, p, 1,
+                                  collapse, epsilon);
+      // the point cloud is no longer needed
+      point_clouds[k].reset();
+    }
+  });
 
+  List ans(num_datasets);
+  for (size_t k = 0; k < num_datasets; ++k) ans[k] = barcodes_to_list(barcodes[k]);
+  return ans;
+}
+
+// precision = 0 --> double
+// precision = 1 --> float, which halves the distance matrix and every column and heap entry
+// num_threads = threads used to assemble and reduce the columns
+// p = one or more primes; returns a list with a dimension/birth/death data frame for each
+// collapse = strong edge collapse of the filtration before any column is assembled
+// epsilon > 0 --> sparse Rips approximation with this error bound instead of the exact filtration
+// profile = attach the wall time and bytes of each phase as attribute profile (see phase_profile)
 // [[Rcpp::export]]
-NumericVector ripser_cpp_dist(const NumericVector& dist_r, int dim, float thresh, int p){
-  std::vector< value_t_ripser > distances( dist_r.size() );
-  std::move(dist_r.begin(), dist_r.end(), distances.begin());
-  compressed_upper_distance_matrix dist = compressed_upper_distance_matrix(std::move(distances));
-  return ripser_compute(dist, dim, thresh, p);
+List ripser_cpp_dist(const NumericVector& dist_r, int dim, float thresh, const std::vector<int>& p, int precision,
+                     int num_threads, bool collapse, double epsilon, bool profile) {
+  check_primes(p);
+
+  std::unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  List ans = barcodes_to_list(
+    precision == 1
+      ? ripser_dist(profiled("input", [&] { return read_dist<float>(dist_r.begin(), dist_r.size()); }), dim,
+                    thresh, p, num_threads, collapse, epsilon)
+      : ripser_dist(profiled("input", [&] { return read_dist<value_t_ripser>(dist_r.begin(), dist_r.size()); }),
+                    dim, thresh, p, num_threads, collapse, epsilon));
+
+  if (phases) ans.attr("profile") = phases->to_data_frame();
+  return ans;
 }
 
 // Altered version of Ripser by Ulrich Bauer
 // format = 0 --> point cloud
 // format = 1 --> lower distance matrix
+// num_threads = threads used to compute point cloud distances and assemble and reduce the columns
+// precision = 0 --> double, 1 --> float
+// p = one or more primes; returns a list with a dimension/birth/death data frame for each
+// collapse = strong edge collapse of the filtration before any column is assembled
+// epsilon > 0 --> sparse Rips approximation with this error bound instead of the exact filtration
+// metric = 0 --> euclidean, 1 --> manhattan, 2 --> maximum, 3 --> cosine, 4 --> correlation (point clouds only)
+// profile = as in ripser_cpp_dist
 // [[Rcpp::export]]
-NumericVector ripser_cpp(const NumericMatrix& input_points, int dim, float thresh, int p, int format) {
+List ripser_cpp(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p, int format,
+                int num_threads, int precision, bool collapse, double epsilon, int metric, bool profile) {
 
   //make sure a valid format is used
   assert(format == 0 || format == 1);
+  check_primes(p);
 
-  //get distance matrix based on input format
-  compressed_lower_distance_matrix dist = read_file(input_points, format);
+  std::unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  List ans = barcodes_to_list(
+    precision == 1
+      ? ripser_points<float>(input_points, dim, thresh, p, format, num_threads, collapse, epsilon, metric)
+      : ripser_points<value_t_ripser>(input_points, dim, thresh, p, format, num_threads, collapse, epsilon,
+                                      metric));
 
-  // Return barcodes
-  return ripser_compute(dist, dim, thresh, p);
+  if (phases) ans.attr("profile") = phases->to_data_frame();
+  return ans;
+}
+
+// Lazy witness complex on num_landmarks maxmin landmarks of a point cloud, with every point as a witness
+// nu = which nearest landmark offsets the witness distances (0, 1 or 2)
+// metric = as in ripser_cpp, for the distances between points, landmarks and witnesses alike
+// returns the barcodes as ripser_cpp does, with the landmark rows (from 1) and the covering radius as attributes
+// profile = as in ripser_cpp_dist
+// [[Rcpp::export]]
+List ripser_cpp_witness(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p,
+                        int num_threads, int precision, int num_landmarks, int nu, bool collapse, int metric,
+                        bool profile) {
+  check_primes(p);
+
+  std::unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  std::vector<index_t_ripser> landmarks;
+  value_t_ripser covering_radius;
+  List ans = barcodes_to_list(
+    precision == 1
+      ? ripser_witness<float>(input_points, dim, thresh, p, num_threads, num_landmarks, nu, collapse, metric,
+                              landmarks, covering_radius)
+      : ripser_witness<value_t_ripser>(input_points, dim, thresh, p, num_threads, num_landmarks, nu, collapse,
+                                       metric, landmarks, covering_radius));
+
+  IntegerVector landmark_rows(landmarks.size());
+  for (size_t k = 0; k < landmarks.size(); ++k) landmark_rows[k] = landmarks[k] + 1;
+  ans.attr("landmarks") = landmark_rows;
+  ans.attr("covering_radius") = covering_radius;
+  if (phases) ans.attr("profile") = phases->to_data_frame();
+  return ans;
+}
+
+// Many point clouds (numeric matrices) and dist objects, in any mix, each computed as ripser_cpp or ripser_cpp_dist
+// would with the same parameters; returns one list of data frames, one per prime, for each dataset
+// num_threads = number of datasets computed at the same time
+// [[Rcpp::export]]
+List ripser_cpp_batch(const List& datasets, int dim, float thresh, const std::vector<int>& p, int precision,
+                      int num_threads, bool collapse, double epsilon) {
+  check_primes(p);
+
+  if (precision == 1)
+    return ripser_batch<float>(datasets, dim, thresh, p, num_threads, collapse, epsilon);
+  return ripser_batch<value_t_ripser>(datasets, dim, thresh, p, num_threads, collapse, epsilon);
+}
+
+// every sample_lag-th value of series, starting from the first
+std::vector<value_t_ripser> delay_samples(const NumericVector& series, int sample_lag) {
+  const R_xlen_t length = series.size();
+  std::vector<value_t_ripser> samples;
+  samples.reserve((length + sample_lag - 1) / sample_lag);
+  for (R_xlen_t k = 0; k < length; k += sample_lag) samples.push_back(series[k]);
+  return samples;
+}
+
+// Delay embedding of a time series (the quasi-attractor of vietoris_rips.numeric), whose distance matrix is built
+// without storing the embedding
+// data_dim = number of coordinates of each point, dim_lag = lag between them, sample_lag = lag between points
+// returns the barcodes as ripser_cpp does for the embedded points
+// profile = as in ripser_cpp_dist
+// [[Rcpp::export]]
+List ripser_cpp_delay(const NumericVector& series, int data_dim, int dim_lag, int sample_lag, int dim, float thresh,
+                      const std::vector<int>& p, int num_threads, int precision, bool collapse, double epsilon,
+                      bool profile) {
+  check_primes(p);
+
+  std::unique_ptr<phase_profile> phases(profile ? new phase_profile() : nullptr);
+  const delay_embedding points = profiled(
+    "input", [&] { return delay_embedding(delay_samples(series, sample_lag), data_dim, dim_lag); });
+
+  List ans = barcodes_to_list(
+    precision == 1 ? ripser_point_cloud<float>(points, dim, thresh, p, num_threads, collapse, epsilon)
+                   : ripser_point_cloud<value_t_ripser>(points, dim, thresh, p, num_threads, collapse, epsilon));
+
+  if (phases) ans.attr("profile") = phases->to_data_frame();
+  return ans;
+}
+
+// estimate of ripser_cpp with the same arguments, before any of it is allocated: a list of the number of simplices of
+// each dimension (from a sample of the distances, under a threshold), the peak bytes, the seconds it would take and
+// whether it would stop because the simplices are too many to index; collapse and epsilon only shrink the
+// filtration, so the estimate leaves them out and bounds their calculation
+// p = the primes passed to ripser_cpp, which bound the simplex indices
+// [[Rcpp::export]]
+List ripser_cpp_estimate(const NumericMatrix& input_points, int dim, float thresh, const std::vector<int>& p,
+                         int num_threads, int precision, int metric, int num_landmarks) {
+  switch (metric) {
+    case MANHATTAN:
+      return ripser_points_estimate<MANHATTAN>(input_points, dim, thresh, p, num_threads, precision,
+                                               num_landmarks);
+    case MAXIMUM:
+      return ripser_points_estimate<MAXIMUM>(input_points, dim, thresh, p, num_threads, precision,
+                                             num_landmarks);
+    case COSINE:
+      return ripser_points_estimate<COSINE>(input_points, dim, thresh, p, num_threads, precision,
+                                            num_landmarks);
+    case CORRELATION:
+      return ripser_points_estimate<CORRELATION>(input_points, dim, thresh, p, num_threads, precision,
+                                                 num_landmarks);
+    default:
+      return ripser_points_estimate<EUCLIDEAN>(input_points, dim, thresh, p, num_threads, precision,
+                                               num_landmarks);
+  }
+}
+
+// estimate of ripser_cpp_dist with the same arguments, as ripser_cpp_estimate is of ripser_cpp
+// [[Rcpp::export]]
+List ripser_cpp_dist_estimate(const NumericVector& dist_r, int dim, float thresh, const std::vector<int>& p,
+                              int num_threads, int precision) {
+  const compressed_upper_distance_matrix<value_t_ripser> dist =
+    read_dist<value_t_ripser>(dist_r.begin(), dist_r.size());
+
+  // the distances are read in place, unless they are copied to single precision
+  return rips_estimate(dist, std::min<index_t_ripser>(dim, dist.size() - 2), thresh, p, num_threads,
+                       precision == 1 ? dist_r.size() * sizeof(float) : 0, 0, 0, thresh > 0);
+}
+
+// estimate of ripser_cpp_delay with the same arguments, as ripser_cpp_estimate is of ripser_cpp, read from the series
+// without embedding it
+// [[Rcpp::export]]
+List ripser_cpp_delay_estimate(const NumericVector& series, int data_dim, int dim_lag, int sample_lag, int dim,
+                               float thresh, const std::vector<int>& p, int num_threads, int precision) {
+  const delay_embedding points(delay_samples(series, sample_lag), data_dim, dim_lag);
+  const double n = points.size(), num_distances = n * (n - 1) / 2;
+  const double value_bytes = precision == 1 ? sizeof(float) : sizeof(value_t_ripser);
+  // a dense matrix takes two terms of the recurrence per distance, and the sparse one every coordinate
+  const double coordinates = thresh <= 0 && dim_lag <= delay_max_recurrence_lag ? 2 : data_dim;
+
+  return rips_estimate(points, std::min<index_t_ripser>(dim, index_t_ripser(n) - 2), thresh, p, num_threads,
+                       points.bytes(), num_distances * value_bytes, num_distances * coordinates, thresh > 0);
 }